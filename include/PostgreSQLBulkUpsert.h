@@ -0,0 +1,78 @@
+#ifndef POSTGRESQL_BULK_UPSERT_H
+#define POSTGRESQL_BULK_UPSERT_H
+
+#include "PostgreSQLConnection.h"
+#include "PostgreSQLSerializer.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+struct BulkUpsertOptions {
+  std::string table; // optionally schema-qualified: "schema.table"
+  std::vector<std::string> columns;
+  std::vector<std::string> keyColumns;
+  // MERGE needs PostgreSQL 15; older servers fall back to ON CONFLICT,
+  // which requires a unique index on the key columns.
+  bool useMerge = true;
+  // Staging defaults to a temp table dropped at commit.
+  bool unloggedStaging = false;
+  // Delete target rows whose key is not present in the staged set.
+  bool deleteMissing = false;
+};
+
+struct BulkUpsertResult {
+  bool success = false;
+  long long inserted = 0;
+  long long updated = 0;
+  long long deleted = 0;
+  std::string errorMessage;
+};
+
+// Syncs a large row set into an existing table in one transaction: rows are
+// streamed with COPY into a staging table and applied with a single MERGE
+// (or INSERT ... ON CONFLICT). Staged keys are expected to be unique. When
+// the connection is already in a transaction the upsert runs in a
+// savepoint, and committing it leaves the outer transaction open.
+class PostgreSQLBulkUpsert {
+private:
+  PostgreSQLConnection &connection;
+  BulkUpsertOptions options;
+  std::unique_ptr<OutputBuffer> copyBuffer;
+  std::string targetTable;
+  std::string stagingTable;
+  // Set when begin() found the caller's transaction open and nested in it.
+  std::string savepoint;
+  bool active;
+  long long stagedRows;
+  std::string errorMessage;
+
+  bool exec(const std::string &sql, long long *affected = nullptr);
+  bool queryCount(const std::string &sql, long long &count);
+  std::string quote(const std::string &identifier) const;
+  std::string columnList(const std::string &prefix = "") const;
+  std::string keyCondition() const;
+  bool finishCopy();
+  BulkUpsertResult fail(const std::string &error);
+
+public:
+  PostgreSQLBulkUpsert(PostgreSQLConnection &conn,
+                       const BulkUpsertOptions &opts);
+  ~PostgreSQLBulkUpsert();
+  PostgreSQLBulkUpsert(const PostgreSQLBulkUpsert &) = delete;
+  PostgreSQLBulkUpsert &operator=(const PostgreSQLBulkUpsert &) = delete;
+
+  bool begin();
+  bool addRow(const std::vector<std::string> &values);
+  // A null pointer is staged as SQL NULL.
+  bool addRow(const std::vector<const char *> &values);
+  BulkUpsertResult commit();
+  void rollback();
+  long long getStagedRows() const;
+  const std::string &getLastError() const;
+
+  static BulkUpsertResult
+  run(PostgreSQLConnection &conn, const BulkUpsertOptions &opts,
+      const std::vector<std::vector<std::string>> &rows);
+};
+
+#endif // POSTGRESQL_BULK_UPSERT_H
@@ -0,0 +1,122 @@
+#ifndef POSTGRESQL_CHANGE_STREAM_H
+#define POSTGRESQL_CHANGE_STREAM_H
+
+#include "PostgreSQLConnection.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class ChangeType { Begin, Commit, Insert, Update, Delete, Truncate };
+
+struct ChangeColumn {
+  std::string name;
+  Oid typeOid = 0;
+  bool isKey = false;
+  bool isNull = false;
+  // TOASTed value that did not change; value is empty.
+  bool isUnchanged = false;
+  std::string value;
+};
+
+struct ChangeEvent {
+  ChangeType type;
+  // Commit: the end of the transaction, i.e. what to acknowledge once it
+  // has been processed. Other events: start of the WAL record.
+  uint64_t lsn;
+  uint32_t xid;
+  std::chrono::system_clock::time_point commitTime;
+  std::string schema;
+  std::string table;
+  std::vector<ChangeColumn> newTuple;
+  // Update/Delete: key columns, or the full old row with REPLICA IDENTITY
+  // FULL. Empty for updates that did not touch the key.
+  std::vector<ChangeColumn> oldTuple;
+  // Truncate: "schema.table" of every truncated relation.
+  std::vector<std::string> truncatedTables;
+};
+
+struct ChangeStreamOptions {
+  std::string slotName;
+  std::vector<std::string> publications;
+  // Create the slot if it does not exist yet.
+  bool createSlot = true;
+  bool temporarySlot = false;
+  // 0 resumes from the slot's confirmed position.
+  uint64_t startLsn = 0;
+  std::chrono::milliseconds statusInterval = std::chrono::seconds(10);
+};
+
+// Change data capture over logical replication with the pgoutput plugin.
+// The connection must be opened with replication=database (see
+// replicationConninfo, which accepts keyword/value strings and URIs) and is
+// owned by the stream while it is running.
+// WAL is retained on the server until the consumer acknowledges it.
+class PostgreSQLChangeStream {
+private:
+  struct RelationColumn {
+    std::string name;
+    Oid typeOid;
+    bool isKey;
+  };
+  struct Relation {
+    std::string schema;
+    std::string table;
+    std::vector<RelationColumn> columns;
+  };
+
+  PostgreSQLConnection &connection;
+  ChangeStreamOptions options;
+  std::unordered_map<uint32_t, Relation> relations;
+  uint64_t receivedLsn;
+  uint64_t acknowledgedLsn;
+  uint32_t currentXid;
+  std::chrono::system_clock::time_point currentCommitTime;
+  std::chrono::steady_clock::time_point lastStatus;
+  bool streaming;
+  std::string lastError;
+
+  bool createSlot();
+  bool handleCopyData(const char *data, size_t size, ChangeEvent &event,
+                      bool &produced);
+  bool decode(const char *data, size_t size, uint64_t walStart,
+              ChangeEvent &event, bool &produced);
+  bool fail(const std::string &message);
+
+  // Feeds recorded CopyData messages through the decoder.
+  friend class ChangeStreamDecodeTest;
+
+public:
+  PostgreSQLChangeStream(PostgreSQLConnection &conn,
+                         const ChangeStreamOptions &opts);
+  ~PostgreSQLChangeStream();
+  PostgreSQLChangeStream(const PostgreSQLChangeStream &) = delete;
+  PostgreSQLChangeStream &operator=(const PostgreSQLChangeStream &) = delete;
+
+  static std::string replicationConninfo(const std::string &conninfo);
+  static bool dropSlot(PostgreSQLConnection &conn, const std::string &slot);
+  static std::string formatLsn(uint64_t lsn);
+  static uint64_t parseLsn(const std::string &text);
+
+  bool start();
+  // Waits up to timeout for the next event. Returns false on timeout or
+  // error; hasError() tells them apart.
+  bool next(ChangeEvent &event, std::chrono::milliseconds timeout);
+  // Everything up to lsn has been processed and may be discarded by the
+  // server. Reported with the next status update.
+  void acknowledge(uint64_t lsn);
+  bool sendStatus(bool replyRequested = false);
+  // Ends streaming. If the server has not finished the stream within
+  // timeout, the connection is reset and false is returned.
+  bool stop(std::chrono::milliseconds timeout = std::chrono::seconds(5));
+
+  bool isStreaming() const;
+  bool hasError() const;
+  const std::string &getLastError() const;
+  uint64_t getReceivedLsn() const;
+  uint64_t getAcknowledgedLsn() const;
+};
+
+#endif // POSTGRESQL_CHANGE_STREAM_H
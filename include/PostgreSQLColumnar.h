@@ -0,0 +1,65 @@
+#ifndef POSTGRESQL_COLUMNAR_H
+#define POSTGRESQL_COLUMNAR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <libpq-fe.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class ColumnType { Int64, Float64, Bool, Timestamp, String };
+
+// One result column as contiguous arrays, laid out like Arrow: bit i of
+// validity (LSB first) is set when row i is not NULL, and the value slot
+// of a NULL row is zero. Timestamps are microseconds since the Unix epoch
+// (UTC for timestamptz, wall clock for timestamp). String row i spans
+// data[offsets[i], offsets[i + 1]).
+struct ColumnArray {
+  std::string name;
+  ColumnType type = ColumnType::String;
+  Oid typeOid = 0;
+  size_t length = 0;
+  size_t nullCount = 0;
+  // Values the server sent but that could not be converted; stored as NULL.
+  size_t conversionErrors = 0;
+  std::vector<uint8_t> validity;
+  std::vector<int64_t> int64Values;
+  std::vector<double> float64Values;
+  // One byte per row rather than bit-packed.
+  std::vector<uint8_t> boolValues;
+  std::vector<int64_t> offsets;
+  std::vector<char> data;
+
+  bool isValid(size_t row) const {
+    return (validity[row >> 3] >> (row & 7)) & 1;
+  }
+  int64_t getInt64(size_t row) const { return int64Values[row]; }
+  double getDouble(size_t row) const { return float64Values[row]; }
+  bool getBool(size_t row) const { return boolValues[row] != 0; }
+  std::string_view getString(size_t row) const {
+    return std::string_view(data.data() + offsets[row],
+                            offsets[row + 1] - offsets[row]);
+  }
+};
+
+struct ColumnarResult {
+  std::vector<ColumnArray> columns;
+  size_t rowCount = 0;
+  std::string errorMessage;
+
+  bool hasError() const { return !errorMessage.empty(); }
+};
+
+// Decodes a PGresult (text or binary format) column by column. Rows are
+// split into 64-row aligned ranges decoded on separate threads, so no two
+// threads ever touch the same validity byte.
+class PostgreSQLColumnar {
+public:
+  // 0 picks std::thread::hardware_concurrency(). Small results are decoded
+  // on the calling thread.
+  static ColumnarResult decode(PGresult *result, size_t threadCount = 0);
+  static ColumnType columnTypeFor(Oid typeOid);
+};
+
+#endif // POSTGRESQL_COLUMNAR_H
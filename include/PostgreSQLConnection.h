@@ -1,12 +1,27 @@
 #ifndef POSTGRESQL_CONNECTION_H
 #define POSTGRESQL_CONNECTION_H
 
+#include <chrono>
 #include <libpq-fe.h>
+#include <mutex>
 #include <string>
 
+// Outcome of PostgreSQLConnection::discardResults().
+enum class DrainResult {
+  Drained,
+  // The connection had to be reset: any open transaction, prepared
+  // statements and session settings are gone.
+  Reset,
+  Failed
+};
+
 class PostgreSQLConnection {
 private:
   PGconn *connection;
+  PGcancel *cancelHandle;
+  // cancel() runs on other threads while reset()/disconnect() replace the
+  // handle.
+  mutable std::mutex cancelMutex;
 
 public:
   PostgreSQLConnection();
@@ -27,6 +42,18 @@ public:
   bool commitTransaction();
   bool rollbackTransaction();
   ConnStatusType getStatus() const;
+  // Asks the server to cancel the running statement. Safe to call from
+  // another thread while this one is blocked in a query.
+  bool cancel();
+  // Consumes input until a result can be read without blocking. Returns
+  // false if the deadline passes or the connection fails first.
+  bool waitForResult(std::chrono::steady_clock::time_point deadline);
+  // Drops every pending result; used to make the connection reusable after
+  // a cancel. Resets the connection if the server does not answer in time
+  // or the statement entered COPY, and reports that as DrainResult::Reset.
+  DrainResult discardResults(std::chrono::milliseconds grace =
+                                 std::chrono::milliseconds(5000));
+  bool reset();
 };
 
 #endif // POSTGRESQL_CONNECTION_H
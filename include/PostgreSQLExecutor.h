@@ -0,0 +1,217 @@
+#ifndef POSTGRESQL_EXECUTOR_H
+#define POSTGRESQL_EXECUTOR_H
+
+#include "PostgreSQLConnection.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free multi-producer/multi-consumer queue (D. Vyukov's
+// sequence-numbered ring). Capacity is rounded up to a power of two.
+template <typename T> class BoundedMPMCQueue {
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  std::unique_ptr<Cell[]> buffer;
+  size_t mask;
+  alignas(64) std::atomic<size_t> enqueuePos;
+  alignas(64) std::atomic<size_t> dequeuePos;
+
+public:
+  explicit BoundedMPMCQueue(size_t capacity) : enqueuePos(0), dequeuePos(0) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    buffer = std::make_unique<Cell[]>(size);
+    mask = size - 1;
+    for (size_t i = 0; i < size; ++i) {
+      buffer[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  BoundedMPMCQueue(const BoundedMPMCQueue &) = delete;
+  BoundedMPMCQueue &operator=(const BoundedMPMCQueue &) = delete;
+
+  bool tryPush(T &value) {
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+      Cell &cell = buffer[pos & mask];
+      size_t seq = cell.sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+          cell.data = std::move(value);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool tryPop(T &value) {
+    size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    while (true) {
+      Cell &cell = buffer[pos & mask];
+      size_t seq = cell.sequence.load(std::memory_order_acquire);
+      intptr_t diff =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeuePos.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+          value = std::move(cell.data);
+          cell.data = T();
+          cell.sequence.store(pos + mask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeuePos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+};
+
+// Runs query tasks on N worker threads, each owning its own connection.
+// Tasks from submit() may be stolen by idle workers; tasks from submitTo()
+// and submitTransaction() always run on a single worker. While a worker's
+// connection is inside a transaction it only runs its pinned tasks, so
+// unrelated work never joins a caller's open transaction.
+//
+// Tasks may submit more work, but shutdown() from a task throws
+// std::logic_error and a submission from a task that finds the queue full
+// throws instead of waiting for the workers, one of which is itself.
+class PostgreSQLExecutor {
+public:
+  using Task = std::function<void(PostgreSQLConnection &)>;
+
+private:
+  struct Worker {
+    PostgreSQLConnection connection;
+    BoundedMPMCQueue<Task> sharedTasks;
+    BoundedMPMCQueue<Task> pinnedTasks;
+    std::thread thread;
+
+    Worker(const std::string &conninfo, size_t queueCapacity)
+        : connection(conninfo), sharedTasks(queueCapacity),
+          pinnedTasks(queueCapacity) {}
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::atomic<size_t> nextWorker;
+  std::atomic<size_t> stolenTasks;
+  std::atomic<size_t> sleepingWorkers;
+  std::atomic<uint32_t> wakeEpoch;
+  std::atomic<size_t> activeSubmitters;
+  // stopping rejects new submissions; stopped lets idle workers exit once
+  // every in-progress submission has been queued.
+  std::atomic<bool> stopping;
+  std::atomic<bool> stopped;
+
+  void workerLoop(size_t index);
+  bool acquireTask(size_t index, Task &task);
+  void enqueueShared(Task task);
+  void enqueuePinned(size_t index, Task task);
+  void beginSubmit();
+  void wakeWorkers();
+  bool onWorkerThread() const;
+
+  template <typename F>
+  static auto
+  makeTask(F &&func,
+           std::future<std::invoke_result_t<F, PostgreSQLConnection &>> &out)
+      -> Task {
+    using R = std::invoke_result_t<F, PostgreSQLConnection &>;
+    auto packaged = std::make_shared<std::packaged_task<R(PostgreSQLConnection &)>>(
+        std::forward<F>(func));
+    out = packaged->get_future();
+    return [packaged](PostgreSQLConnection &conn) { (*packaged)(conn); };
+  }
+
+public:
+  PostgreSQLExecutor(const std::string &conninfo, size_t workerCount = 0,
+                     size_t queueCapacity = 1024);
+  ~PostgreSQLExecutor();
+  PostgreSQLExecutor(const PostgreSQLExecutor &) = delete;
+  PostgreSQLExecutor &operator=(const PostgreSQLExecutor &) = delete;
+
+  template <typename F>
+  auto submit(F &&func)
+      -> std::future<std::invoke_result_t<F, PostgreSQLConnection &>> {
+    std::future<std::invoke_result_t<F, PostgreSQLConnection &>> future;
+    enqueueShared(makeTask(std::forward<F>(func), future));
+    return future;
+  }
+
+  // Use pickWorker() once and pass the index to every submitTo() call that
+  // belongs to the same session or transaction.
+  template <typename F>
+  auto submitTo(size_t workerIndex, F &&func)
+      -> std::future<std::invoke_result_t<F, PostgreSQLConnection &>> {
+    if (workerIndex >= workers.size()) {
+      throw std::out_of_range("Executor worker index out of range");
+    }
+    std::future<std::invoke_result_t<F, PostgreSQLConnection &>> future;
+    enqueuePinned(workerIndex, makeTask(std::forward<F>(func), future));
+    return future;
+  }
+
+  // Runs func between BEGIN and COMMIT on one worker; an exception thrown by
+  // func rolls the transaction back and is rethrown through the future.
+  template <typename F>
+  auto submitTransaction(F &&func)
+      -> std::future<std::invoke_result_t<F, PostgreSQLConnection &>> {
+    return submitTo(
+        pickWorker(),
+        [func = std::forward<F>(func)](PostgreSQLConnection &conn) mutable
+        -> std::invoke_result_t<F, PostgreSQLConnection &> {
+          if (!conn.beginTransaction()) {
+            throw std::runtime_error("BEGIN failed: " + conn.getLastError());
+          }
+          try {
+            if constexpr (std::is_void_v<
+                              std::invoke_result_t<F, PostgreSQLConnection &>>) {
+              func(conn);
+              if (!conn.commitTransaction()) {
+                throw std::runtime_error("COMMIT failed: " +
+                                         conn.getLastError());
+              }
+            } else {
+              auto value = func(conn);
+              if (!conn.commitTransaction()) {
+                throw std::runtime_error("COMMIT failed: " +
+                                         conn.getLastError());
+              }
+              return value;
+            }
+          } catch (...) {
+            conn.rollbackTransaction();
+            throw;
+          }
+        });
+  }
+
+  size_t pickWorker();
+  size_t getWorkerCount() const;
+  size_t getStolenCount() const;
+  void shutdown();
+};
+
+#endif // POSTGRESQL_EXECUTOR_H
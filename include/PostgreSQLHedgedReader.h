@@ -0,0 +1,66 @@
+#ifndef POSTGRESQL_HEDGED_READER_H
+#define POSTGRESQL_HEDGED_READER_H
+
+#include "PostgreSQLConnection.h"
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Sends an idempotent read to the primary connection and, if it has not
+// answered within the observed p95 latency, duplicates it on the secondary.
+// The first answer wins; the other statement is cancelled right away and
+// drained at the start of the next read, so the caller never waits for it.
+// If the primary cannot take the statement at all, it goes to the secondary.
+// Only use it for statements that are safe to run twice.
+//
+// The reader takes exclusive ownership of both connections for its
+// lifetime: after read() returns, the losing connection may still be busy
+// with the cancelled statement ("another command is already in progress").
+// Call drainAbandoned() before using either connection elsewhere.
+class PostgreSQLHedgedReader {
+private:
+  PostgreSQLConnection &primary;
+  PostgreSQLConnection &secondary;
+  std::vector<long long> latencies;
+  size_t nextSample;
+  std::chrono::microseconds initialHedgeDelay;
+  std::chrono::microseconds minHedgeDelay;
+  size_t hedgedCount;
+  size_t secondaryWins;
+  // Cancelled statements whose results are still to be discarded.
+  bool primaryAbandoned;
+  bool secondaryAbandoned;
+
+  void recordLatency(std::chrono::microseconds latency);
+  static bool send(PostgreSQLConnection &conn, const std::string &query,
+                   const std::vector<std::string> &params);
+  static PGresult *collect(PostgreSQLConnection &conn,
+                           std::chrono::steady_clock::time_point deadline);
+  void abandon(PostgreSQLConnection &conn);
+
+public:
+  PostgreSQLHedgedReader(PostgreSQLConnection &primaryConn,
+                         PostgreSQLConnection &secondaryConn,
+                         size_t latencyWindow = 256,
+                         std::chrono::microseconds initialDelay =
+                             std::chrono::milliseconds(20));
+  ~PostgreSQLHedgedReader();
+  PostgreSQLHedgedReader(const PostgreSQLHedgedReader &) = delete;
+  PostgreSQLHedgedReader &operator=(const PostgreSQLHedgedReader &) = delete;
+
+  // Returns nullptr on error or when the timeout (zero = none) expires.
+  PGresult *read(const std::string &query,
+                 const std::vector<std::string> &params = {},
+                 std::chrono::milliseconds timeout =
+                     std::chrono::milliseconds(0));
+  // Waits for cancelled statements to finish (or resets their connection)
+  // so both connections are idle again.
+  void drainAbandoned();
+  std::chrono::microseconds getHedgeDelay() const;
+  void setMinHedgeDelay(std::chrono::microseconds delay);
+  size_t getHedgedCount() const;
+  size_t getSecondaryWins() const;
+};
+
+#endif // POSTGRESQL_HEDGED_READER_H
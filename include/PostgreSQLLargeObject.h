@@ -0,0 +1,52 @@
+#ifndef POSTGRESQL_LARGE_OBJECT_H
+#define POSTGRESQL_LARGE_OBJECT_H
+
+#include "PostgreSQLConnection.h"
+#include <cstddef>
+#include <cstdio>
+#include <istream>
+#include <libpq/libpq-fs.h>
+#include <ostream>
+#include <span>
+
+// Streaming access to a large object through lo_open/lo_read/lo_write.
+// All I/O goes through caller-supplied buffers; nothing is accumulated in
+// memory. Large object descriptors only live inside a transaction.
+class PostgreSQLLargeObject {
+private:
+  PostgreSQLConnection &connection;
+  Oid objectId;
+  int descriptor;
+
+public:
+  explicit PostgreSQLLargeObject(PostgreSQLConnection &conn);
+  ~PostgreSQLLargeObject();
+  PostgreSQLLargeObject(const PostgreSQLLargeObject &) = delete;
+  PostgreSQLLargeObject &operator=(const PostgreSQLLargeObject &) = delete;
+
+  static Oid create(PostgreSQLConnection &conn);
+  static bool remove(PostgreSQLConnection &conn, Oid oid);
+
+  bool open(Oid oid, int mode = INV_READ);
+  bool close();
+  bool isOpen() const;
+  Oid getOid() const;
+
+  // Returns the number of bytes transferred, 0 at end of object, -1 on error.
+  long long read(std::span<std::byte> buffer);
+  long long write(std::span<const std::byte> data);
+  long long seek(long long offset, int whence = SEEK_SET);
+  long long tell();
+  long long size();
+  bool truncate(long long length);
+
+  // Copy the whole object to/from a sink using buffer as the only staging
+  // area. Return the number of bytes copied or -1 on error, including an
+  // empty buffer.
+  long long readTo(int fd, std::span<std::byte> buffer);
+  long long readTo(std::ostream &output, std::span<std::byte> buffer);
+  long long writeFrom(int fd, std::span<std::byte> buffer);
+  long long writeFrom(std::istream &input, std::span<std::byte> buffer);
+};
+
+#endif // POSTGRESQL_LARGE_OBJECT_H
@@ -0,0 +1,124 @@
+#ifndef POSTGRESQL_PARAM_ARRAY_H
+#define POSTGRESQL_PARAM_ARRAY_H
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// libpq wants NUL-terminated text. Short views are terminated in an inline
+// buffer; only text longer than InlineBytes goes to the heap.
+class NullTerminatedText {
+private:
+  static constexpr size_t InlineBytes = 1024;
+  char inlineBuffer[InlineBytes];
+  std::unique_ptr<char[]> heapBuffer;
+  const char *text;
+
+public:
+  explicit NullTerminatedText(std::string_view view) {
+    char *target = view.size() < InlineBytes
+                       ? inlineBuffer
+                       : (heapBuffer = std::make_unique<char[]>(view.size() + 1))
+                             .get();
+    std::memcpy(target, view.data(), view.size());
+    target[view.size()] = '\0';
+    text = target;
+  }
+  NullTerminatedText(const NullTerminatedText &) = delete;
+  NullTerminatedText &operator=(const NullTerminatedText &) = delete;
+
+  const char *c_str() const { return text; }
+};
+
+// Parameter value array for PQexecParams that stays on the stack for up to
+// InlineParams parameters (and InlineBytes of copied view data).
+class ParamArray {
+private:
+  static constexpr size_t InlineParams = 16;
+  static constexpr size_t InlineBytes = 1024;
+  const char *inlineValues[InlineParams];
+  char inlineBytes[InlineBytes];
+  std::unique_ptr<const char *[]> heapValues;
+  std::unique_ptr<char[]> heapBytes;
+  const char **values;
+  int count;
+
+  void allocateValues(size_t size) {
+    count = static_cast<int>(size);
+    values = size <= InlineParams
+                 ? inlineValues
+                 : (heapValues = std::make_unique<const char *[]>(size)).get();
+  }
+
+  static const std::string_view *valueOf(const std::string_view &param) {
+    return &param;
+  }
+  static const std::string_view *
+  valueOf(const std::optional<std::string_view> &param) {
+    return param ? &*param : nullptr;
+  }
+
+  template <typename View> void copyViews(std::span<const View> params) {
+    allocateValues(params.size());
+    size_t total = 0;
+    for (const auto &param : params) {
+      const std::string_view *value = valueOf(param);
+      total += value ? value->size() + 1 : 0;
+    }
+    char *bytes = total <= InlineBytes
+                      ? inlineBytes
+                      : (heapBytes = std::make_unique<char[]>(total)).get();
+    for (size_t i = 0; i < params.size(); ++i) {
+      const std::string_view *value = valueOf(params[i]);
+      if (!value) {
+        values[i] = nullptr;
+        continue;
+      }
+      if (!value->empty()) {
+        std::memcpy(bytes, value->data(), value->size());
+      }
+      bytes[value->size()] = '\0';
+      values[i] = bytes;
+      bytes += value->size() + 1;
+    }
+  }
+
+public:
+  explicit ParamArray(std::span<const std::string> params) {
+    allocateValues(params.size());
+    for (size_t i = 0; i < params.size(); ++i) {
+      values[i] = params[i].c_str();
+    }
+  }
+
+  explicit ParamArray(std::span<const char *const> params) {
+    allocateValues(params.size());
+    for (size_t i = 0; i < params.size(); ++i) {
+      values[i] = params[i];
+    }
+  }
+
+  // Every view is a value, including an empty or default-constructed one
+  // (the empty string).
+  explicit ParamArray(std::span<const std::string_view> params) {
+    copyViews(params);
+  }
+
+  // std::nullopt is passed as SQL NULL.
+  explicit ParamArray(
+      std::span<const std::optional<std::string_view>> params) {
+    copyViews(params);
+  }
+
+  ParamArray(const ParamArray &) = delete;
+  ParamArray &operator=(const ParamArray &) = delete;
+
+  const char *const *data() const { return count ? values : nullptr; }
+  int size() const { return count; }
+};
+
+#endif // POSTGRESQL_PARAM_ARRAY_H
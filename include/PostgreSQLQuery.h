@@ -2,12 +2,35 @@
 #define POSTGRESQL_QUERY_H
 
 #include "PostgreSQLConnection.h"
+#include "PostgreSQLParamArray.h"
+#include "PostgreSQLSlowQueryLog.h"
+#include <chrono>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class PostgreSQLQuery {
 private:
+  // Simple query protocol, unnamed extended statement, or a statement
+  // prepared earlier on this session (query is then its name).
+  enum class Protocol { Simple, Extended, Prepared };
+
   PostgreSQLConnection &connection;
+  PostgreSQLSlowQueryLog *slowQueryLog;
+  std::chrono::milliseconds statementTimeout;
+  bool timedOut;
+  bool connectionReset;
+
+  PGresult *dispatch(const char *query, int paramCount,
+                     const char *const *paramValues, Protocol protocol,
+                     int resultFormat, std::chrono::milliseconds timeout);
+  PGresult *awaitResult(std::chrono::steady_clock::time_point deadline);
+  void recordIfSlow(const char *query, bool prepared, int paramCount,
+                    const char *const *paramValues,
+                    std::chrono::steady_clock::time_point started,
+                    PGresult *result);
 
 public:
   explicit PostgreSQLQuery(PostgreSQLConnection &conn);
@@ -17,10 +40,31 @@ public:
   PostgreSQLQuery &operator=(const PostgreSQLQuery &) = delete;
 
   PGresult *execute(const std::string &query);
+  PGresult *execute(const char *query);
+  PGresult *execute(std::string_view query);
+  // Per-call deadline: when it passes the statement is cancelled and the
+  // connection drained so it can be reused; nullptr is returned.
+  PGresult *execute(const std::string &query,
+                    std::chrono::milliseconds timeout);
   PGresult *executeParams(const std::string &query,
                           const std::vector<std::string> &params);
+  PGresult *executeParams(const std::string &query,
+                          const std::vector<std::string> &params,
+                          std::chrono::milliseconds timeout);
   PGresult *executeParams(const std::string &query,
                           const std::vector<const char *> &params);
+  // Allocation-free for up to 16 parameters and 1 KiB of text. Every view
+  // is sent as a value; use the std::optional overload to send SQL NULL.
+  PGresult *executeParams(std::string_view query,
+                          std::span<const std::string_view> params);
+  // std::nullopt is sent as SQL NULL.
+  PGresult *
+  executeParams(std::string_view query,
+                std::span<const std::optional<std::string_view>> params);
+  // Requests every result column in binary format, so bytea values arrive
+  // raw instead of hex-escaped; read them with PostgreSQLUtils::getBytes.
+  PGresult *executeParamsBinary(const std::string &query,
+                                const std::vector<std::string> &params);
   PGresult *executePrepared(const std::string &stmtName,
                             const std::vector<std::string> &params);
   bool executeCommand(const std::string &query);
@@ -29,6 +73,17 @@ public:
                             const std::string &defaultValue = "");
   bool isConnectionOK() const;
   std::string getLastError() const;
+  // Statements slower than the log's threshold are recorded there.
+  void setSlowQueryLog(PostgreSQLSlowQueryLog *log);
+  // Default deadline for execute()/executeParams(); zero disables it.
+  void setStatementTimeout(std::chrono::milliseconds timeout);
+  bool lastCallTimedOut() const;
+  // The last call had to reset the connection to recover it (deadline
+  // cancel not answered, or the statement started a COPY): the open
+  // transaction, prepared statements and session settings were lost.
+  bool lastCallResetConnection() const;
+  // May be called from another thread to abort the running statement.
+  bool cancel();
 };
 
 #endif // POSTGRESQL_QUERY_H
@@ -0,0 +1,101 @@
+#ifndef POSTGRESQL_SERIALIZER_H
+#define POSTGRESQL_SERIALIZER_H
+
+#include "PostgreSQLUtils.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class SerializationFormat { CSV, TSV, JSONLines, Table };
+
+// Large write-behind buffer in front of a file descriptor, an ostream or a
+// custom sink (e.g. PQputCopyData).
+// Nothing is flushed until the buffer fills up or flush() is called.
+class OutputBuffer {
+private:
+  std::unique_ptr<char[]> buffer;
+  size_t capacity;
+  size_t used;
+  int fd;
+  std::ostream *stream;
+  std::function<bool(const char *, size_t)> sink;
+  bool failed;
+
+  void drain(const char *data, size_t size);
+
+public:
+  explicit OutputBuffer(int fd, size_t capacity = 1 << 16);
+  explicit OutputBuffer(std::ostream &stream, size_t capacity = 1 << 16);
+  explicit OutputBuffer(std::function<bool(const char *, size_t)> sink,
+                        size_t capacity = 1 << 16);
+  ~OutputBuffer();
+  OutputBuffer(const OutputBuffer &) = delete;
+  OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+  void append(const char *data, size_t size);
+  void append(std::string_view text) { append(text.data(), text.size()); }
+  void append(char c) {
+    if (used == capacity) {
+      flush();
+    }
+    buffer[used++] = c;
+  }
+  void appendRepeated(char c, size_t count);
+  void appendNumber(size_t value);
+  bool flush();
+  bool hasError() const;
+};
+
+// Streaming writer for CSV, TSV (COPY text format) and JSON Lines. A null
+// value pointer is written as SQL NULL.
+class RowSerializer {
+private:
+  enum class JsonKind : uint8_t { String, Number, Bool };
+
+  OutputBuffer &output;
+  SerializationFormat format;
+  std::vector<std::string> jsonKeys;
+  std::vector<JsonKind> jsonKinds;
+  size_t rowCount;
+
+  void writeField(const char *value, size_t length, size_t column);
+
+public:
+  RowSerializer(OutputBuffer &out, SerializationFormat fmt);
+
+  void writeHeader(const std::vector<std::string> &columns,
+                   bool emitHeaderLine = true);
+  // Text-format type OIDs; JSON Lines then writes numeric and boolean
+  // columns as JSON numbers and booleans instead of strings.
+  void setColumnTypes(const std::vector<Oid> &types);
+  void writeRow(const char *const *values, const int *lengths, size_t count);
+  void writeRow(const std::vector<std::string> &values);
+  size_t getRowCount() const;
+};
+
+class PostgreSQLSerializer {
+public:
+  static bool write(PGresult *result, SerializationFormat format,
+                    OutputBuffer &output, bool header = true);
+  static bool write(const QueryResult &result, SerializationFormat format,
+                    OutputBuffer &output, bool header = true);
+  static bool write(PGresult *result, SerializationFormat format, int fd,
+                    bool header = true);
+  static bool write(PGresult *result, SerializationFormat format,
+                    std::ostream &output, bool header = true);
+  static void writeTable(PGresult *result, OutputBuffer &output);
+  static void writeTable(const QueryResult &result, OutputBuffer &output);
+  static void appendCsvEscaped(OutputBuffer &output, const char *value,
+                               size_t length);
+  static void appendTsvEscaped(OutputBuffer &output, const char *value,
+                               size_t length);
+  static void appendJsonEscaped(OutputBuffer &output, const char *value,
+                                size_t length);
+};
+
+#endif // POSTGRESQL_SERIALIZER_H
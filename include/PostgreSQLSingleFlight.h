@@ -0,0 +1,64 @@
+#ifndef POSTGRESQL_SINGLE_FLIGHT_H
+#define POSTGRESQL_SINGLE_FLIGHT_H
+
+#include "PostgreSQLConnection.h"
+#include "PostgreSQLUtils.h"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Collapses identical concurrent reads. The first caller for a given SQL,
+// parameter list, memory budget and server/database/role runs it on its own
+// connection; callers arriving while it is in flight wait and share the
+// same immutable result (errors included). A result that spilled to disk
+// is not shared: each waiter then runs the statement itself. Nothing is
+// cached: once the leader finishes, the next call goes to the database
+// again.
+//
+// Only use it for statements that do not depend on the caller's session
+// state, e.g. not inside an open transaction.
+class PostgreSQLSingleFlight {
+public:
+  using SharedResult = std::shared_ptr<const QueryResult>;
+
+private:
+  std::unordered_map<std::string, std::shared_future<SharedResult>> inFlight;
+  std::mutex mutex;
+  std::atomic<size_t> executedCount;
+  std::atomic<size_t> sharedCount;
+
+  static std::string makeKey(PostgreSQLConnection &connection,
+                             const std::string &query,
+                             const std::vector<std::string> &params,
+                             size_t memoryBudget);
+  SharedResult run(const std::string &key,
+                   const std::function<QueryResult()> &execute);
+
+  // Drives run() with stand-in executions.
+  friend class SingleFlightTest;
+
+public:
+  PostgreSQLSingleFlight();
+  PostgreSQLSingleFlight(const PostgreSQLSingleFlight &) = delete;
+  PostgreSQLSingleFlight &operator=(const PostgreSQLSingleFlight &) = delete;
+
+  SharedResult executeQuery(PostgreSQLConnection &connection,
+                            const std::string &query,
+                            size_t memoryBudget = 0);
+  SharedResult executeQueryParams(PostgreSQLConnection &connection,
+                                  const std::string &query,
+                                  const std::vector<std::string> &params,
+                                  size_t memoryBudget = 0);
+  size_t getInFlightCount();
+  // Statements actually sent vs. callers served by another caller's result.
+  size_t getExecutedCount() const;
+  size_t getSharedCount() const;
+};
+
+#endif // POSTGRESQL_SINGLE_FLIGHT_H
@@ -0,0 +1,92 @@
+#ifndef POSTGRESQL_SLOW_QUERY_LOG_H
+#define POSTGRESQL_SLOW_QUERY_LOG_H
+
+#include "PostgreSQLConnection.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct SlowQueryEntry {
+  std::chrono::system_clock::time_point timestamp;
+  std::string query;
+  // std::nullopt for SQL NULL.
+  std::vector<std::optional<std::string>> params;
+  std::chrono::microseconds duration;
+  long long rows;
+  std::string explainPlan;
+};
+
+struct SlowQueryLogConfig {
+  std::chrono::microseconds threshold = std::chrono::milliseconds(500);
+  size_t capacity = 128;
+  bool redactParams = true;
+  // EXPLAIN (FORMAT JSON) is re-run for one in explainSampleRate slow
+  // queries (0 disables it), at most once per explainMinInterval. Plans are
+  // produced by a background thread on the side connection and attached to
+  // the entry when ready; entries evicted before then keep no plan.
+  size_t explainSampleRate = 0;
+  std::chrono::milliseconds explainMinInterval = std::chrono::seconds(10);
+};
+
+// Bounded ring of the most recent statements that crossed the latency
+// threshold. Safe to share between threads and PostgreSQLQuery instances.
+class PostgreSQLSlowQueryLog {
+private:
+  SlowQueryLogConfig config;
+  PostgreSQLConnection *explainConnection;
+  std::vector<SlowQueryEntry> entries;
+  // totalRecorded at the time each slot was written, so a finished EXPLAIN
+  // can tell whether its entry has been overwritten since.
+  std::vector<size_t> entrySequence;
+  size_t nextSlot;
+  size_t totalRecorded;
+  std::chrono::steady_clock::time_point lastExplain;
+  mutable std::mutex mutex;
+  std::mutex explainMutex;
+
+  struct ExplainJob {
+    size_t sequence;
+    std::string query;
+    std::vector<std::optional<std::string>> params;
+  };
+  std::deque<ExplainJob> explainQueue;
+  std::condition_variable explainReady;
+  bool stopping;
+  std::thread explainWorker;
+
+  void explainLoop();
+  std::string explain(const std::string &query,
+                      const std::vector<std::optional<std::string>> &params);
+
+public:
+  explicit PostgreSQLSlowQueryLog(const SlowQueryLogConfig &cfg = {});
+  ~PostgreSQLSlowQueryLog();
+  PostgreSQLSlowQueryLog(const PostgreSQLSlowQueryLog &) = delete;
+  PostgreSQLSlowQueryLog &operator=(const PostgreSQLSlowQueryLog &) = delete;
+
+  // The side connection must not be used by anything else while set.
+  // Clearing it waits for an EXPLAIN that is already running.
+  void setExplainConnection(PostgreSQLConnection *conn);
+  std::chrono::microseconds getThreshold() const;
+  bool isSlow(std::chrono::microseconds duration) const;
+  // Pass explainable = false when query is only a label that cannot be
+  // planned on the side connection, e.g. "EXECUTE name" of a statement
+  // prepared on another session.
+  void record(const std::string &query,
+              const std::vector<std::optional<std::string>> &params,
+              std::chrono::microseconds duration, long long rows,
+              bool explainable = true);
+  std::vector<SlowQueryEntry> getEntries() const;
+  size_t getTotalRecorded() const;
+  void clear();
+  void dump(std::ostream &output = std::cerr) const;
+};
+
+#endif // POSTGRESQL_SLOW_QUERY_LOG_H
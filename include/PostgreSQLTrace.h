@@ -0,0 +1,85 @@
+#ifndef POSTGRESQL_TRACE_H
+#define POSTGRESQL_TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct TraceSpan {
+  const char *name;
+  const char *category;
+  std::string detail;
+  uint64_t traceId;
+  uint64_t spanId;
+  uint64_t parentId;
+  uint64_t startNs;
+  uint64_t durationNs;
+  uint32_t threadId;
+};
+
+// Process-wide span collector. Each thread appends to its own buffer, so
+// recording only contends with a concurrent collect().
+class PostgreSQLTrace {
+public:
+  static void setEnabled(bool enabled);
+  static bool isEnabled();
+  // Spans beyond this many per thread are dropped (and counted).
+  static void setThreadBufferCapacity(size_t spans);
+  static size_t getDroppedCount();
+
+  static void record(TraceSpan span);
+  // Drains every thread buffer; spans are ordered by start time.
+  static std::vector<TraceSpan> collect();
+  static void clear();
+
+  // Chrome Trace Event format, loadable in chrome://tracing and Perfetto.
+  static bool writeChromeTrace(std::ostream &output);
+  static bool writeChromeTrace(const std::string &path);
+  // OTLP/JSON ExportTraceServiceRequest, as accepted by OTLP/HTTP collectors.
+  static bool writeOtlpJson(std::ostream &output,
+                            const std::string &serviceName = "pqxx-executor");
+  static bool writeOtlpJson(const std::string &path,
+                            const std::string &serviceName = "pqxx-executor");
+
+  static uint64_t nowNs();
+};
+
+// Times the enclosing scope. Nested scopes on the same thread become child
+// spans of the innermost open one.
+class TraceScope {
+private:
+  const char *name;
+  const char *category;
+  std::string detail;
+  uint64_t traceId;
+  uint64_t spanId;
+  uint64_t parentId;
+  uint64_t startNs;
+  bool active;
+
+public:
+  TraceScope(const char *spanName, const char *spanCategory,
+             std::string_view spanDetail = {});
+  ~TraceScope();
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+};
+
+// Instrumentation hooks. Unless the library is built with
+// PQXX_EXECUTOR_TRACING they expand to nothing, arguments included.
+#define PQXX_TRACE_CONCAT_INNER(a, b) a##b
+#define PQXX_TRACE_CONCAT(a, b) PQXX_TRACE_CONCAT_INNER(a, b)
+#ifdef PQXX_EXECUTOR_TRACING
+#define PQXX_TRACE_SPAN(name, category)                                        \
+  TraceScope PQXX_TRACE_CONCAT(traceScope, __LINE__)(name, category)
+#define PQXX_TRACE_SPAN_DETAIL(name, category, detail)                         \
+  TraceScope PQXX_TRACE_CONCAT(traceScope, __LINE__)(name, category, detail)
+#else
+#define PQXX_TRACE_SPAN(name, category) ((void)0)
+#define PQXX_TRACE_SPAN_DETAIL(name, category, detail) ((void)0)
+#endif
+
+#endif // POSTGRESQL_TRACE_H
@@ -2,9 +2,15 @@
 #define POSTGRESQL_UTILS_H
 
 #include "PostgreSQLConnection.h"
+#include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 // RAII обёртка для PGresult
@@ -26,21 +32,37 @@ public:
   void reset(PGresult *res = nullptr);
 };
 
+// Column names and their index, shared by every row of a result.
+struct ResultColumns {
+  std::vector<std::string> names;
+  std::map<std::string, int, std::less<>> indexMap;
+  // Type OIDs when loaded from a PGresult; empty otherwise.
+  std::vector<Oid> types;
+
+  explicit ResultColumns(std::vector<std::string> columnNames);
+};
+
 class ResultRow {
 private:
   std::vector<std::string> values;
-  std::vector<std::string> columns;
-  std::map<std::string, int> columnIndexMap;
+  std::shared_ptr<const ResultColumns> columns;
+
+  int findColumn(std::string_view columnName) const;
 
 public:
   ResultRow();
   ResultRow(const std::vector<std::string> &colNames,
             const std::vector<std::string> &rowValues);
+  ResultRow(std::shared_ptr<const ResultColumns> sharedColumns,
+            std::vector<std::string> rowValues);
 
   std::string getString(const std::string &columnName,
                         const std::string &defaultValue = "") const;
   std::string getString(int columnIndex,
                         const std::string &defaultValue = "") const;
+  // Views into the row; empty when the column does not exist.
+  std::string_view getView(std::string_view columnName) const;
+  std::string_view getView(int columnIndex) const;
   int getInt(const std::string &columnName, int defaultValue = 0) const;
   int getInt(int columnIndex, int defaultValue = 0) const;
   double getDouble(const std::string &columnName,
@@ -59,24 +81,59 @@ public:
   const std::vector<std::string> &getColumns() const;
 };
 
+class ResultSpillFile;
+
 class QueryResult {
 private:
   std::vector<ResultRow> rows;
-  std::vector<std::string> columnNames;
+  std::shared_ptr<const ResultColumns> columns;
   int affectedRows;
   std::string errorMessage;
+  // Rows beyond the memory budget are spilled to a temp file; rows
+  // [rows.size(), rows.size() + spilled count) are read back through mmap.
+  size_t memoryBudget;
+  size_t memoryUsage;
+  size_t columnOverhead;
+  std::shared_ptr<ResultSpillFile> spill;
+  // Spilled rows handed out through the non-const getRow().
+  std::unordered_map<size_t, ResultRow> pinnedRows;
+  mutable ResultRow spilledRow;
+  mutable size_t spilledRowIndex;
+
+  bool reserveMemory(size_t bytes);
+  void releaseMemory();
+  bool spillRow(PGresult *result, int row, int colCount);
 
 public:
   QueryResult();
   QueryResult(PGresult *result);
+  ~QueryResult();
+  QueryResult(const QueryResult &other);
+  QueryResult &operator=(const QueryResult &other);
+  QueryResult(QueryResult &&other) noexcept;
+  QueryResult &operator=(QueryResult &&other) noexcept;
 
   bool loadFromResult(PGresult *result);
+  // Incremental loading, used for single-row mode streaming.
+  void setColumns(PGresult *result);
+  bool appendRows(PGresult *result);
+  bool finishRows();
+  void setAffectedRows(int count);
   void clear();
 
   const ResultRow &getRow(size_t index) const;
+  // For a spilled row this copies the row into memory for the lifetime of
+  // the result, so that writes through the reference are kept.
   ResultRow &getRow(size_t index);
+  // Materializing a spilled result would defeat its memory budget, so on a
+  // spilled result (isSpilled()) this throws std::logic_error; iterate with
+  // forEachRow() or getRow() when spilling is enabled.
   const std::vector<ResultRow> &getAllRows() const;
+  // Visits every row, spilled ones included, one at a time. Stops early
+  // and returns false when visit returns false.
+  bool forEachRow(const std::function<bool(const ResultRow &)> &visit) const;
   const std::vector<std::string> &getColumnNames() const;
+  const std::vector<Oid> &getColumnTypes() const;
 
   size_t getRowCount() const;
   size_t getColumnCount() const;
@@ -89,16 +146,52 @@ public:
   std::string getFirstValue(const std::string &columnName,
                             const std::string &defaultValue = "") const;
   int getFirstInt(const std::string &columnName, int defaultValue = 0) const;
+
+  // Memory budgets in bytes; 0 means unlimited. The per-query budget falls
+  // back to the default budget when not set explicitly. A query that
+  // exceeds its budget fails with "Memory budget exceeded" unless spilling
+  // to disk is enabled, in which case the remaining rows are spilled.
+  void setMemoryBudget(size_t bytes);
+  size_t getMemoryUsage() const;
+  bool isSpilled() const;
+  size_t getSpilledRowCount() const;
+  static void setDefaultMemoryBudget(size_t bytes);
+  static size_t getDefaultMemoryBudget();
+  static void setGlobalMemoryBudget(size_t bytes);
+  static size_t getGlobalMemoryBudget();
+  static size_t getGlobalMemoryUsage();
+  // Off by default; see getAllRows() for what changes for spilled results.
+  static void setSpillEnabled(bool enabled);
+  static bool isSpillEnabled();
+  static bool isMemoryBudgetActive();
 };
 
 class PostgreSQLUtils {
 public:
   // Выполнение запроса и получение результата
+  // With a memory budget active the rows are fetched in single-row mode and
+  // spilled to disk once the budget is exhausted.
   static QueryResult executeQuery(PostgreSQLConnection &connection,
-                                  const std::string &query);
+                                  const std::string &query,
+                                  size_t memoryBudget = 0);
   static QueryResult executeQueryParams(PostgreSQLConnection &connection,
                                         const std::string &query,
-                                        const std::vector<std::string> &params);
+                                        const std::vector<std::string> &params,
+                                        size_t memoryBudget = 0);
+  static QueryResult executeQuery(PostgreSQLConnection &connection,
+                                  const char *query, size_t memoryBudget = 0);
+  static QueryResult executeQuery(PostgreSQLConnection &connection,
+                                  std::string_view query,
+                                  size_t memoryBudget = 0);
+  static QueryResult
+  executeQueryParams(PostgreSQLConnection &connection, std::string_view query,
+                     std::span<const std::string_view> params,
+                     size_t memoryBudget = 0);
+  // std::nullopt is sent as SQL NULL.
+  static QueryResult
+  executeQueryParams(PostgreSQLConnection &connection, std::string_view query,
+                     std::span<const std::optional<std::string_view>> params,
+                     size_t memoryBudget = 0);
   static void printResult(const QueryResult &result,
                           std::ostream &output = std::cout);
   static void printResult(PGresult *result, std::ostream &output = std::cout);
@@ -109,6 +202,11 @@ public:
   static int getColumnCount(PGresult *result);
   static std::string getValue(PGresult *result, int row, int col,
                               const std::string &defaultValue = "");
+  static std::string_view getValueView(PGresult *result, int row, int col);
+  // Zero-copy view of a binary-format value (see executeParamsBinary); the
+  // span points into the PGresult and is empty for text-format columns.
+  static std::span<const std::byte> getBytes(PGresult *result, int row,
+                                             int col);
   static bool isResultValid(PGresult *result);
   static bool hasRows(PGresult *result);
   static std::string resultStatusToString(ExecStatusType status);
@@ -0,0 +1,65 @@
+#ifndef POSTGRESQL_WRITE_COALESCER_H
+#define POSTGRESQL_WRITE_COALESCER_H
+
+#include "PostgreSQLConnection.h"
+#include "PostgreSQLUtils.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct WriteStatement {
+  std::string query;
+  std::vector<std::string> params;
+};
+
+// Group commit: small write units from many threads are packed into one
+// transaction, each unit guarded by its own savepoint. A batch is sent as
+// one libpq pipeline, so it costs one round trip plus one per failed unit. The coalescer takes
+// exclusive ownership of the connection while it is running.
+class PostgreSQLWriteCoalescer {
+private:
+  struct PendingUnit {
+    std::vector<WriteStatement> statements;
+    std::promise<QueryResult> promise;
+  };
+
+  PostgreSQLConnection &connection;
+  size_t maxBatchSize;
+  std::chrono::microseconds maxDelay;
+  std::deque<PendingUnit> queue;
+  std::mutex queueMutex;
+  std::condition_variable queueCondition;
+  bool stopping;
+  size_t committedBatches;
+  size_t committedUnits;
+  std::thread writer;
+
+  void writerLoop();
+  void flushBatch(std::vector<PendingUnit> &batch);
+
+public:
+  PostgreSQLWriteCoalescer(PostgreSQLConnection &conn,
+                           size_t maxBatchSize = 256,
+                           std::chrono::microseconds maxDelay =
+                               std::chrono::microseconds(2000));
+  ~PostgreSQLWriteCoalescer();
+  PostgreSQLWriteCoalescer(const PostgreSQLWriteCoalescer &) = delete;
+  PostgreSQLWriteCoalescer &
+  operator=(const PostgreSQLWriteCoalescer &) = delete;
+
+  std::future<QueryResult> submit(const std::string &query,
+                                  const std::vector<std::string> &params = {});
+  std::future<QueryResult> submit(std::vector<WriteStatement> statements);
+  void shutdown();
+  size_t getPendingCount();
+  size_t getCommittedBatches();
+  size_t getCommittedUnits();
+};
+
+#endif // POSTGRESQL_WRITE_COALESCER_H
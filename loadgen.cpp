@@ -0,0 +1,454 @@
+#include "./include/PostgreSQLConnection.h"
+#include "./include/PostgreSQLParamArray.h"
+#include "./include/PostgreSQLQuery.h"
+#include "./include/PostgreSQLUtils.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// pgbench-style load generator. Every line of the workload file is one
+// statement; the whole file is one transaction that each client repeats
+// until the duration elapses:
+//
+//   SQL<TAB>param1<TAB>param2...
+//
+// A parameter is a literal or one of the placeholders {random:LO:HI},
+// {thread} (client number) and {seq} (transaction number, unique across
+// clients). Empty lines and lines starting with '#' are skipped.
+
+// Pipelined sends through raw libpq (PQsendQueryParams/PQpipelineSync):
+// PostgreSQLQuery has no pipeline API, so that mode measures the protocol
+// rather than this library's query path. Deadline runs every statement
+// through PostgreSQLQuery's per-call timeout, i.e. PQsendQuery* plus a
+// poll() wait; the client still waits for each statement in turn.
+enum class LoadMode { Simple, Prepared, Pipelined, Deadline };
+
+struct ParamTemplate {
+  enum Kind { Literal, Random, Thread, Sequence } kind = Literal;
+  std::string literal;
+  long long low = 0;
+  long long high = 0;
+};
+
+struct WorkloadStatement {
+  std::string sql;
+  std::vector<ParamTemplate> params;
+};
+
+struct LoadOptions {
+  std::string conninfo;
+  std::string workloadFile;
+  LoadMode mode = LoadMode::Simple;
+  int clients = 1;
+  int durationSeconds = 10;
+  // Per-statement deadline in deadline mode.
+  std::chrono::milliseconds timeout = std::chrono::milliseconds(30000);
+};
+
+struct ClientStats {
+  std::vector<uint32_t> latenciesUs;
+  size_t errors = 0;
+};
+
+static bool parseMode(const std::string &name, LoadMode &mode) {
+  if (name == "simple") {
+    mode = LoadMode::Simple;
+  } else if (name == "prepared") {
+    mode = LoadMode::Prepared;
+  } else if (name == "pipelined") {
+    mode = LoadMode::Pipelined;
+  } else if (name == "deadline") {
+    mode = LoadMode::Deadline;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static bool parseParam(const std::string &text, ParamTemplate &param) {
+  if (text == "{thread}") {
+    param.kind = ParamTemplate::Thread;
+  } else if (text == "{seq}") {
+    param.kind = ParamTemplate::Sequence;
+  } else if (text.rfind("{random:", 0) == 0 && text.back() == '}') {
+    param.kind = ParamTemplate::Random;
+    if (std::sscanf(text.c_str(), "{random:%lld:%lld}", &param.low,
+                    &param.high) != 2 ||
+        param.low > param.high) {
+      return false;
+    }
+  } else {
+    param.literal = text;
+  }
+  return true;
+}
+
+static bool loadWorkload(const std::string &path,
+                         std::vector<WorkloadStatement> &statements) {
+  std::ifstream input(path);
+  if (!input) {
+    std::cerr << "Cannot open workload file: " << path << std::endl;
+    return false;
+  }
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(input, line)) {
+    ++lineNumber;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    WorkloadStatement statement;
+    std::getline(fields, statement.sql, '\t');
+    std::string field;
+    while (std::getline(fields, field, '\t')) {
+      ParamTemplate param;
+      if (!parseParam(field, param)) {
+        std::cerr << path << ":" << lineNumber
+                  << ": invalid parameter: " << field << std::endl;
+        return false;
+      }
+      statement.params.push_back(std::move(param));
+    }
+    statements.push_back(std::move(statement));
+  }
+  if (statements.empty()) {
+    std::cerr << "Workload file has no statements: " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+class LoadClient {
+private:
+  const LoadOptions &options;
+  const std::vector<WorkloadStatement> &statements;
+  std::atomic<long long> &sequence;
+  const std::atomic<bool> &stopping;
+  int clientId;
+  std::mt19937_64 random;
+  PostgreSQLConnection connection;
+  PostgreSQLQuery query;
+  std::vector<std::vector<std::string>> boundParams;
+
+  void bindParams(long long seq) {
+    for (size_t i = 0; i < statements.size(); ++i) {
+      const auto &templates = statements[i].params;
+      auto &values = boundParams[i];
+      for (size_t j = 0; j < templates.size(); ++j) {
+        const ParamTemplate &param = templates[j];
+        switch (param.kind) {
+        case ParamTemplate::Literal:
+          values[j] = param.literal;
+          break;
+        case ParamTemplate::Random:
+          values[j] = std::to_string(std::uniform_int_distribution<long long>(
+              param.low, param.high)(random));
+          break;
+        case ParamTemplate::Thread:
+          values[j] = std::to_string(clientId);
+          break;
+        case ParamTemplate::Sequence:
+          values[j] = std::to_string(seq);
+          break;
+        }
+      }
+    }
+  }
+
+  bool runStatement(size_t index) {
+    const std::string &sql = statements[index].sql;
+    const auto &params = boundParams[index];
+    PGresult *result = nullptr;
+    switch (options.mode) {
+    case LoadMode::Simple:
+      result = params.empty() ? query.execute(sql)
+                              : query.executeParams(sql, params);
+      break;
+    case LoadMode::Prepared:
+      result = query.executePrepared(statementName(index), params);
+      break;
+    case LoadMode::Deadline:
+      result = params.empty()
+                   ? query.execute(sql, options.timeout)
+                   : query.executeParams(sql, params, options.timeout);
+      break;
+    case LoadMode::Pipelined:
+      break;
+    }
+    if (!result) {
+      return false;
+    }
+    PQclear(result);
+    return true;
+  }
+
+  // The whole transaction goes out as one pipeline with a single sync, so
+  // it costs one round trip regardless of the statement count.
+  bool runPipeline() {
+    PGconn *conn = connection.getRawConnection();
+    for (size_t i = 0; i < statements.size(); ++i) {
+      ParamArray values{std::span<const std::string>(boundParams[i])};
+      if (!PQsendQueryParams(conn, statements[i].sql.c_str(), values.size(),
+                             nullptr, values.data(), nullptr, nullptr, 0)) {
+        std::cerr << "Pipeline send failed: " << connection.getLastError()
+                  << std::endl;
+        return false;
+      }
+    }
+    if (!PQpipelineSync(conn)) {
+      return false;
+    }
+    bool ok = true;
+    while (true) {
+      PGresult *raw = PQgetResult(conn);
+      if (!raw) {
+        // End of one statement's results, or the connection is gone.
+        if (connection.getStatus() != CONNECTION_OK) {
+          return false;
+        }
+        continue;
+      }
+      PGResultWrapper result(raw);
+      ExecStatusType status = PQresultStatus(raw);
+      if (status == PGRES_PIPELINE_SYNC) {
+        break;
+      }
+      if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
+        if (ok && status != PGRES_PIPELINE_ABORTED) {
+          std::cerr << "Pipelined statement failed: "
+                    << PQresultErrorMessage(raw);
+        }
+        ok = false;
+      }
+    }
+    return ok;
+  }
+
+  bool runTransaction() {
+    if (options.mode == LoadMode::Pipelined) {
+      return runPipeline();
+    }
+    for (size_t i = 0; i < statements.size(); ++i) {
+      if (!runStatement(i)) {
+        // Leave the connection usable if the script opened a transaction.
+        if (PQtransactionStatus(connection.getRawConnection()) ==
+            PQTRANS_INERROR) {
+          connection.rollbackTransaction();
+        }
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static std::string statementName(size_t index) {
+    return "loadgen_" + std::to_string(index);
+  }
+
+public:
+  LoadClient(const LoadOptions &opts,
+             const std::vector<WorkloadStatement> &workload,
+             std::atomic<long long> &seq, const std::atomic<bool> &stop,
+             int id)
+      : options(opts), statements(workload), sequence(seq), stopping(stop),
+        clientId(id), random(std::random_device{}() + id),
+        connection(opts.conninfo), query(connection) {
+    boundParams.resize(statements.size());
+    for (size_t i = 0; i < statements.size(); ++i) {
+      boundParams[i].resize(statements[i].params.size());
+    }
+  }
+
+  bool setup() {
+    PGconn *conn = connection.getRawConnection();
+    if (options.mode == LoadMode::Prepared) {
+      for (size_t i = 0; i < statements.size(); ++i) {
+        PGResultWrapper prepared(PQprepare(
+            conn, statementName(i).c_str(), statements[i].sql.c_str(),
+            statements[i].params.size(), nullptr));
+        if (PQresultStatus(prepared.get()) != PGRES_COMMAND_OK) {
+          std::cerr << "Prepare failed: " << connection.getLastError()
+                    << std::endl;
+          return false;
+        }
+      }
+    }
+    if (options.mode == LoadMode::Pipelined && !PQenterPipelineMode(conn)) {
+      std::cerr << "Cannot enter pipeline mode" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  void run(ClientStats &stats) {
+    while (!stopping.load(std::memory_order_relaxed)) {
+      bindParams(sequence.fetch_add(1, std::memory_order_relaxed));
+      auto started = std::chrono::steady_clock::now();
+      bool ok = runTransaction();
+      auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - started);
+      if (ok) {
+        stats.latenciesUs.push_back(static_cast<uint32_t>(
+            std::min<long long>(elapsed.count(), UINT32_MAX)));
+      } else {
+        ++stats.errors;
+        if (connection.getStatus() != CONNECTION_OK) {
+          std::cerr << "Client " << clientId << " lost its connection"
+                    << std::endl;
+          return;
+        }
+      }
+    }
+  }
+};
+
+static double percentileMs(const std::vector<uint32_t> &sorted,
+                           double percentile) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  size_t index = static_cast<size_t>(percentile / 100.0 * (sorted.size() - 1));
+  return sorted[index] / 1000.0;
+}
+
+static const char *modeName(LoadMode mode) {
+  switch (mode) {
+  case LoadMode::Simple:
+    return "simple";
+  case LoadMode::Prepared:
+    return "prepared";
+  case LoadMode::Pipelined:
+    return "pipelined";
+  case LoadMode::Deadline:
+    return "deadline";
+  }
+  return "unknown";
+}
+
+static void printUsage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " -d CONNINFO -f WORKLOAD [-c CLIENTS] [-T SECONDS]"
+               " [-M simple|prepared|pipelined|deadline] [-t TIMEOUT_MS]"
+            << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  LoadOptions options;
+  int opt;
+  while ((opt = getopt(argc, argv, "d:f:c:T:M:t:h")) != -1) {
+    switch (opt) {
+    case 'd':
+      options.conninfo = optarg;
+      break;
+    case 'f':
+      options.workloadFile = optarg;
+      break;
+    case 'c':
+      options.clients = std::atoi(optarg);
+      break;
+    case 'T':
+      options.durationSeconds = std::atoi(optarg);
+      break;
+    case 'M':
+      if (!parseMode(optarg, options.mode)) {
+        std::cerr << "Unknown mode: " << optarg << std::endl;
+        return 1;
+      }
+      break;
+    case 't':
+      options.timeout = std::chrono::milliseconds(std::atoi(optarg));
+      break;
+    default:
+      printUsage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (options.conninfo.empty() || options.workloadFile.empty() ||
+      options.clients < 1 || options.durationSeconds < 1) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  std::vector<WorkloadStatement> statements;
+  if (!loadWorkload(options.workloadFile, statements)) {
+    return 1;
+  }
+
+  std::atomic<long long> sequence(1);
+  std::atomic<bool> stopping(false);
+  std::vector<std::unique_ptr<LoadClient>> clients;
+  try {
+    for (int i = 0; i < options.clients; ++i) {
+      auto client = std::make_unique<LoadClient>(options, statements, sequence,
+                                                 stopping, i);
+      if (!client->setup()) {
+        std::cerr << "Client " << i << " setup failed" << std::endl;
+        return 1;
+      }
+      clients.push_back(std::move(client));
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  std::vector<ClientStats> stats(clients.size());
+  std::vector<std::thread> threads;
+  auto started = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < clients.size(); ++i) {
+    threads.emplace_back(&LoadClient::run, clients[i].get(),
+                         std::ref(stats[i]));
+  }
+  std::this_thread::sleep_for(std::chrono::seconds(options.durationSeconds));
+  stopping.store(true);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+
+  std::vector<uint32_t> latencies;
+  size_t errors = 0;
+  for (auto &clientStats : stats) {
+    latencies.insert(latencies.end(), clientStats.latenciesUs.begin(),
+                     clientStats.latenciesUs.end());
+    errors += clientStats.errors;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  size_t total = latencies.size() + errors;
+  double sum = 0;
+  for (uint32_t latency : latencies) {
+    sum += latency;
+  }
+
+  std::printf("mode: %s\n", modeName(options.mode));
+  std::printf("clients: %d\n", options.clients);
+  std::printf("statements per transaction: %zu\n", statements.size());
+  std::printf("duration: %.3f s\n", elapsed);
+  std::printf("transactions: %zu (%zu failed, %.3f%%)\n", total, errors,
+              total ? 100.0 * errors / total : 0.0);
+  std::printf("tps: %.1f\n", latencies.size() / elapsed);
+  std::printf("latency avg: %.3f ms\n",
+              latencies.empty() ? 0.0 : sum / latencies.size() / 1000.0);
+  std::printf("latency p50: %.3f ms\n", percentileMs(latencies, 50));
+  std::printf("latency p90: %.3f ms\n", percentileMs(latencies, 90));
+  std::printf("latency p95: %.3f ms\n", percentileMs(latencies, 95));
+  std::printf("latency p99: %.3f ms\n", percentileMs(latencies, 99));
+  std::printf("latency max: %.3f ms\n",
+              latencies.empty() ? 0.0 : latencies.back() / 1000.0);
+  return 0;
+}
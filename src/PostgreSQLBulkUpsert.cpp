@@ -0,0 +1,385 @@
+#include "../include/PostgreSQLBulkUpsert.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+static std::atomic<unsigned> stagingCounter(0);
+
+PostgreSQLBulkUpsert::PostgreSQLBulkUpsert(PostgreSQLConnection &conn,
+                                           const BulkUpsertOptions &opts)
+    : connection(conn), options(opts), active(false), stagedRows(0) {}
+
+PostgreSQLBulkUpsert::~PostgreSQLBulkUpsert() { rollback(); }
+
+std::string PostgreSQLBulkUpsert::quote(const std::string &identifier) const {
+  char *escaped = PQescapeIdentifier(connection.getRawConnection(),
+                                     identifier.c_str(), identifier.size());
+  if (!escaped) {
+    return "\"" + identifier + "\"";
+  }
+  std::string quoted = escaped;
+  PQfreemem(escaped);
+  return quoted;
+}
+
+std::string PostgreSQLBulkUpsert::columnList(const std::string &prefix) const {
+  std::string list;
+  for (const auto &column : options.columns) {
+    if (!list.empty()) {
+      list += ", ";
+    }
+    list += prefix + quote(column);
+  }
+  return list;
+}
+
+std::string PostgreSQLBulkUpsert::keyCondition() const {
+  std::string condition;
+  for (const auto &key : options.keyColumns) {
+    if (!condition.empty()) {
+      condition += " AND ";
+    }
+    condition += "t." + quote(key) + " = s." + quote(key);
+  }
+  return condition;
+}
+
+bool PostgreSQLBulkUpsert::exec(const std::string &sql, long long *affected) {
+  PGresult *result = PQexec(connection.getRawConnection(), sql.c_str());
+  ExecStatusType status = PQresultStatus(result);
+  bool ok = status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK;
+  if (!ok) {
+    errorMessage = connection.getLastError();
+  } else if (affected) {
+    const char *tuples = PQcmdTuples(result);
+    *affected = tuples && *tuples ? std::atoll(tuples) : 0;
+  }
+  PQclear(result);
+  return ok;
+}
+
+bool PostgreSQLBulkUpsert::queryCount(const std::string &sql,
+                                      long long &count) {
+  PGresult *result = PQexec(connection.getRawConnection(), sql.c_str());
+  bool ok = PQresultStatus(result) == PGRES_TUPLES_OK && PQntuples(result) > 0;
+  if (ok) {
+    count = std::atoll(PQgetvalue(result, 0, 0));
+  } else {
+    errorMessage = connection.getLastError();
+  }
+  PQclear(result);
+  return ok;
+}
+
+bool PostgreSQLBulkUpsert::begin() {
+  if (active) {
+    errorMessage = "Bulk upsert already in progress";
+    return false;
+  }
+  if (options.table.empty() || options.columns.empty() ||
+      options.keyColumns.empty()) {
+    errorMessage = "Table, columns and key columns are required";
+    return false;
+  }
+  for (const auto &key : options.keyColumns) {
+    if (std::find(options.columns.begin(), options.columns.end(), key) ==
+        options.columns.end()) {
+      errorMessage = "Key column " + key + " is not in the column list";
+      return false;
+    }
+  }
+  if (!connection.isOK()) {
+    errorMessage = "Connection is not established";
+    return false;
+  }
+  targetTable.clear();
+  size_t start = 0;
+  while (true) {
+    size_t dot = options.table.find('.', start);
+    if (!targetTable.empty()) {
+      targetTable += '.';
+    }
+    targetTable += quote(options.table.substr(start, dot - start));
+    if (dot == std::string::npos) {
+      break;
+    }
+    start = dot + 1;
+  }
+
+  // Unique per session and per upsert object, so two upserts on one
+  // connection never share a staging table or savepoint.
+  std::string name =
+      "bulk_upsert_" +
+      std::to_string(PQbackendPID(connection.getRawConnection())) + "_" +
+      std::to_string(stagingCounter.fetch_add(1));
+  PGTransactionStatusType txStatus =
+      PQtransactionStatus(connection.getRawConnection());
+  if (txStatus == PQTRANS_INTRANS) {
+    // Inside the caller's transaction: BEGIN would only warn and our
+    // COMMIT/ROLLBACK would end the caller's transaction, so nest instead.
+    savepoint = quote(name);
+    if (!exec("SAVEPOINT " + savepoint)) {
+      savepoint.clear();
+      return false;
+    }
+  } else if (txStatus != PQTRANS_IDLE) {
+    errorMessage = "Connection is busy or its transaction has failed";
+    return false;
+  } else {
+    savepoint.clear();
+    if (!connection.beginTransaction()) {
+      errorMessage = connection.getLastError();
+      return false;
+    }
+  }
+  active = true;
+  // CREATE TABLE AS copies the column types without the target's
+  // constraints, so the staging table accepts any row shape.
+  std::string select =
+      " AS SELECT " + columnList() + " FROM " + targetTable + " WITH NO DATA";
+  bool created;
+  stagingTable = quote(name);
+  if (options.unloggedStaging) {
+    created = exec("CREATE UNLOGGED TABLE " + stagingTable + select);
+  } else {
+    created = exec("CREATE TEMP TABLE " + stagingTable + " ON COMMIT DROP" +
+                   select);
+  }
+  if (!created) {
+    rollback();
+    return false;
+  }
+
+  std::string copy =
+      "COPY " + stagingTable + " (" + columnList() + ") FROM STDIN";
+  PGresult *result = PQexec(connection.getRawConnection(), copy.c_str());
+  bool copying = PQresultStatus(result) == PGRES_COPY_IN;
+  PQclear(result);
+  if (!copying) {
+    errorMessage = connection.getLastError();
+    rollback();
+    return false;
+  }
+  PGconn *rawConn = connection.getRawConnection();
+  copyBuffer = std::make_unique<OutputBuffer>(
+      [rawConn](const char *data, size_t size) {
+        return PQputCopyData(rawConn, data, static_cast<int>(size)) == 1;
+      },
+      1 << 18);
+  stagedRows = 0;
+  return true;
+}
+
+bool PostgreSQLBulkUpsert::addRow(const std::vector<std::string> &values) {
+  if (!copyBuffer) {
+    errorMessage = "Bulk upsert not started";
+    return false;
+  }
+  if (values.size() != options.columns.size()) {
+    errorMessage = "Row has " + std::to_string(values.size()) +
+                   " values, expected " +
+                   std::to_string(options.columns.size());
+    return false;
+  }
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (i > 0) {
+      copyBuffer->append('\t');
+    }
+    PostgreSQLSerializer::appendTsvEscaped(*copyBuffer, values[i].data(),
+                                           values[i].size());
+  }
+  copyBuffer->append('\n');
+  ++stagedRows;
+  return !copyBuffer->hasError();
+}
+
+bool PostgreSQLBulkUpsert::addRow(const std::vector<const char *> &values) {
+  if (!copyBuffer) {
+    errorMessage = "Bulk upsert not started";
+    return false;
+  }
+  if (values.size() != options.columns.size()) {
+    errorMessage = "Row has " + std::to_string(values.size()) +
+                   " values, expected " +
+                   std::to_string(options.columns.size());
+    return false;
+  }
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (i > 0) {
+      copyBuffer->append('\t');
+    }
+    if (values[i]) {
+      PostgreSQLSerializer::appendTsvEscaped(*copyBuffer, values[i],
+                                             std::strlen(values[i]));
+    } else {
+      copyBuffer->append("\\N", 2);
+    }
+  }
+  copyBuffer->append('\n');
+  ++stagedRows;
+  return !copyBuffer->hasError();
+}
+
+bool PostgreSQLBulkUpsert::finishCopy() {
+  bool sent = copyBuffer->flush();
+  copyBuffer.reset();
+  PGconn *rawConn = connection.getRawConnection();
+  if (PQputCopyEnd(rawConn, sent ? nullptr : "bulk upsert aborted") != 1) {
+    errorMessage = connection.getLastError();
+    return false;
+  }
+  bool ok = sent;
+  while (PGresult *result = PQgetResult(rawConn)) {
+    if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+      errorMessage = connection.getLastError();
+      ok = false;
+    }
+    PQclear(result);
+  }
+  return ok;
+}
+
+BulkUpsertResult PostgreSQLBulkUpsert::fail(const std::string &error) {
+  BulkUpsertResult result;
+  result.errorMessage = error.empty() ? errorMessage : error;
+  errorMessage = result.errorMessage;
+  rollback();
+  return result;
+}
+
+BulkUpsertResult PostgreSQLBulkUpsert::commit() {
+  if (!active || !copyBuffer) {
+    return fail("Bulk upsert not started");
+  }
+  if (!finishCopy()) {
+    return fail("");
+  }
+  long long matched = 0;
+  if (!exec("ANALYZE " + stagingTable) ||
+      !queryCount("SELECT count(*) FROM " + stagingTable + " AS s JOIN " +
+                      targetTable + " AS t ON " + keyCondition(),
+                  matched)) {
+    return fail("");
+  }
+
+  std::vector<std::string> valueColumns;
+  for (const auto &column : options.columns) {
+    if (std::find(options.keyColumns.begin(), options.keyColumns.end(),
+                  column) == options.keyColumns.end()) {
+      valueColumns.push_back(column);
+    }
+  }
+  bool useMerge = options.useMerge &&
+                  PQserverVersion(connection.getRawConnection()) >= 150000;
+  std::string apply;
+  if (useMerge) {
+    apply = "MERGE INTO " + targetTable + " AS t USING " + stagingTable +
+            " AS s ON " + keyCondition();
+    if (!valueColumns.empty()) {
+      apply += " WHEN MATCHED THEN UPDATE SET ";
+      for (size_t i = 0; i < valueColumns.size(); ++i) {
+        apply += (i ? ", " : "") + quote(valueColumns[i]) + " = s." +
+                 quote(valueColumns[i]);
+      }
+    }
+    apply += " WHEN NOT MATCHED THEN INSERT (" + columnList() +
+             ") VALUES (" + columnList("s.") + ")";
+  } else {
+    std::string keys;
+    for (const auto &key : options.keyColumns) {
+      keys += (keys.empty() ? "" : ", ") + quote(key);
+    }
+    apply = "INSERT INTO " + targetTable + " (" + columnList() + ") SELECT " +
+            columnList() + " FROM " + stagingTable + " ON CONFLICT (" + keys +
+            ") DO ";
+    if (valueColumns.empty()) {
+      apply += "NOTHING";
+    } else {
+      apply += "UPDATE SET ";
+      for (size_t i = 0; i < valueColumns.size(); ++i) {
+        apply += (i ? ", " : "") + quote(valueColumns[i]) + " = EXCLUDED." +
+                 quote(valueColumns[i]);
+      }
+    }
+  }
+
+  BulkUpsertResult result;
+  long long affected = 0;
+  if (!exec(apply, &affected)) {
+    return fail("");
+  }
+  result.updated = valueColumns.empty() ? 0 : matched;
+  result.inserted = affected - result.updated;
+  if (options.deleteMissing &&
+      !exec("DELETE FROM " + targetTable + " AS t WHERE NOT EXISTS " +
+                "(SELECT 1 FROM " + stagingTable + " AS s WHERE " +
+                keyCondition() + ")",
+            &result.deleted)) {
+    return fail("");
+  }
+  // A temp table only goes away at the end of the caller's transaction.
+  if ((options.unloggedStaging || !savepoint.empty()) &&
+      !exec("DROP TABLE " + stagingTable)) {
+    return fail("");
+  }
+  if (!savepoint.empty()) {
+    if (!exec("RELEASE SAVEPOINT " + savepoint)) {
+      return fail("");
+    }
+  } else if (!connection.commitTransaction()) {
+    return fail(connection.getLastError());
+  }
+  active = false;
+  result.success = true;
+  return result;
+}
+
+void PostgreSQLBulkUpsert::rollback() {
+  if (copyBuffer) {
+    copyBuffer.reset();
+    PGconn *rawConn = connection.getRawConnection();
+    if (PQputCopyEnd(rawConn, "bulk upsert aborted") == 1) {
+      while (PGresult *result = PQgetResult(rawConn)) {
+        PQclear(result);
+      }
+    }
+  }
+  if (active) {
+    // The staging table was created inside the transaction (or savepoint)
+    // and goes with it.
+    if (!savepoint.empty()) {
+      std::string saved = errorMessage;
+      exec("ROLLBACK TO SAVEPOINT " + savepoint);
+      exec("RELEASE SAVEPOINT " + savepoint);
+      errorMessage = saved;
+    } else {
+      connection.rollbackTransaction();
+    }
+    active = false;
+  }
+}
+
+long long PostgreSQLBulkUpsert::getStagedRows() const { return stagedRows; }
+
+const std::string &PostgreSQLBulkUpsert::getLastError() const {
+  return errorMessage;
+}
+
+BulkUpsertResult
+PostgreSQLBulkUpsert::run(PostgreSQLConnection &conn,
+                          const BulkUpsertOptions &opts,
+                          const std::vector<std::vector<std::string>> &rows) {
+  PostgreSQLBulkUpsert upsert(conn, opts);
+  if (!upsert.begin()) {
+    BulkUpsertResult result;
+    result.errorMessage = upsert.getLastError();
+    return result;
+  }
+  for (const auto &row : rows) {
+    if (!upsert.addRow(row)) {
+      return upsert.fail("");
+    }
+  }
+  return upsert.commit();
+}
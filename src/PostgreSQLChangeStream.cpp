@@ -0,0 +1,610 @@
+#include "../include/PostgreSQLChangeStream.h"
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+
+namespace {
+
+// Microseconds between the Unix epoch and the PostgreSQL epoch (2000-01-01).
+constexpr int64_t PostgresEpochOffsetUs = 946684800000000LL;
+
+std::chrono::system_clock::time_point fromPostgresTime(int64_t micros) {
+  return std::chrono::system_clock::time_point(
+      std::chrono::microseconds(micros + PostgresEpochOffsetUs));
+}
+
+int64_t postgresNow() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+             .count() -
+         PostgresEpochOffsetUs;
+}
+
+void putUint64(char *target, uint64_t value) {
+  for (int i = 7; i >= 0; --i) {
+    target[i] = static_cast<char>(value & 0xFF);
+    value >>= 8;
+  }
+}
+
+// Bounds-checked reader for the network-order replication messages. Any
+// overrun latches the reader into a failed state instead of reading past
+// the buffer.
+class MessageReader {
+private:
+  const unsigned char *cursor;
+  const unsigned char *end;
+  bool ok;
+
+  uint64_t readInteger(size_t bytes) {
+    if (!ok || static_cast<size_t>(end - cursor) < bytes) {
+      ok = false;
+      return 0;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+      value = (value << 8) | cursor[i];
+    }
+    cursor += bytes;
+    return value;
+  }
+
+public:
+  MessageReader(const char *data, size_t size)
+      : cursor(reinterpret_cast<const unsigned char *>(data)),
+        end(reinterpret_cast<const unsigned char *>(data) + size), ok(true) {}
+
+  uint8_t readUint8() { return static_cast<uint8_t>(readInteger(1)); }
+  uint16_t readUint16() { return static_cast<uint16_t>(readInteger(2)); }
+  uint32_t readUint32() { return static_cast<uint32_t>(readInteger(4)); }
+  uint64_t readUint64() { return readInteger(8); }
+
+  std::string readString() {
+    const void *terminator =
+        ok ? std::memchr(cursor, '\0', end - cursor) : nullptr;
+    if (!terminator) {
+      ok = false;
+      return {};
+    }
+    std::string value(reinterpret_cast<const char *>(cursor),
+                      static_cast<const unsigned char *>(terminator) - cursor);
+    cursor += value.size() + 1;
+    return value;
+  }
+
+  std::string readBytes(size_t length) {
+    if (!ok || static_cast<size_t>(end - cursor) < length) {
+      ok = false;
+      return {};
+    }
+    std::string value(reinterpret_cast<const char *>(cursor), length);
+    cursor += length;
+    return value;
+  }
+
+  bool good() const { return ok; }
+};
+
+std::string quoteIdentifier(PGconn *conn, const std::string &name) {
+  char *quoted = PQescapeIdentifier(conn, name.c_str(), name.size());
+  if (!quoted) {
+    return {};
+  }
+  std::string result = quoted;
+  PQfreemem(quoted);
+  return result;
+}
+
+std::string quoteLiteral(PGconn *conn, const std::string &value) {
+  char *quoted = PQescapeLiteral(conn, value.c_str(), value.size());
+  if (!quoted) {
+    return {};
+  }
+  std::string result = quoted;
+  PQfreemem(quoted);
+  return result;
+}
+
+} // namespace
+
+PostgreSQLChangeStream::PostgreSQLChangeStream(PostgreSQLConnection &conn,
+                                               const ChangeStreamOptions &opts)
+    : connection(conn), options(opts), receivedLsn(0), acknowledgedLsn(0),
+      currentXid(0), streaming(false) {
+  if (options.statusInterval.count() <= 0) {
+    options.statusInterval = std::chrono::seconds(10);
+  }
+}
+
+PostgreSQLChangeStream::~PostgreSQLChangeStream() {
+  if (streaming) {
+    stop();
+  }
+}
+
+std::string
+PostgreSQLChangeStream::replicationConninfo(const std::string &conninfo) {
+  // Parsed and re-emitted as keyword/value pairs: appending to a URI
+  // ("postgresql://...") would not be understood.
+  char *error = nullptr;
+  PQconninfoOption *options = PQconninfoParse(conninfo.c_str(), &error);
+  if (!options) {
+    std::cerr << "Invalid connection string: " << (error ? error : "")
+              << std::endl;
+    PQfreemem(error);
+    return conninfo + " replication=database";
+  }
+  std::string result;
+  for (PQconninfoOption *option = options; option->keyword; ++option) {
+    if (!option->val || std::strcmp(option->keyword, "replication") == 0) {
+      continue;
+    }
+    result += option->keyword;
+    result += "='";
+    for (const char *c = option->val; *c; ++c) {
+      if (*c == '\\' || *c == '\'') {
+        result += '\\';
+      }
+      result += *c;
+    }
+    result += "' ";
+  }
+  PQconninfoFree(options);
+  return result + "replication=database";
+}
+
+bool PostgreSQLChangeStream::dropSlot(PostgreSQLConnection &conn,
+                                      const std::string &slot) {
+  if (!conn.isOK()) {
+    return false;
+  }
+  const char *values[] = {slot.c_str()};
+  PGresult *result =
+      PQexecParams(conn.getRawConnection(),
+                   "SELECT pg_drop_replication_slot($1)", 1, nullptr, values,
+                   nullptr, nullptr, 0);
+  bool success = PQresultStatus(result) == PGRES_TUPLES_OK;
+  if (!success) {
+    std::cerr << "Failed to drop replication slot " << slot << ": "
+              << conn.getLastError() << std::endl;
+  }
+  PQclear(result);
+  return success;
+}
+
+std::string PostgreSQLChangeStream::formatLsn(uint64_t lsn) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%X/%X", static_cast<uint32_t>(lsn >> 32),
+                static_cast<uint32_t>(lsn));
+  return text;
+}
+
+uint64_t PostgreSQLChangeStream::parseLsn(const std::string &text) {
+  uint32_t high = 0;
+  uint32_t low = 0;
+  if (std::sscanf(text.c_str(), "%" SCNx32 "/%" SCNx32, &high, &low) != 2) {
+    return 0;
+  }
+  return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+bool PostgreSQLChangeStream::fail(const std::string &message) {
+  lastError = message;
+  std::cerr << "Change stream: " << message << std::endl;
+  return false;
+}
+
+bool PostgreSQLChangeStream::createSlot() {
+  PGconn *conn = connection.getRawConnection();
+  std::string command = "CREATE_REPLICATION_SLOT " +
+                        quoteIdentifier(conn, options.slotName) +
+                        (options.temporarySlot ? " TEMPORARY" : "") +
+                        " LOGICAL pgoutput NOEXPORT_SNAPSHOT";
+  PGresult *result = PQexec(conn, command.c_str());
+  bool success = PQresultStatus(result) == PGRES_TUPLES_OK;
+  if (!success) {
+    // duplicate_object: the slot already exists, which is what we want.
+    const char *state = PQresultErrorField(result, PG_DIAG_SQLSTATE);
+    success = state && std::strcmp(state, "42710") == 0;
+  }
+  PQclear(result);
+  if (!success) {
+    return fail("Failed to create replication slot: " +
+                connection.getLastError());
+  }
+  return true;
+}
+
+bool PostgreSQLChangeStream::start() {
+  lastError.clear();
+  if (streaming) {
+    return true;
+  }
+  if (!connection.isOK()) {
+    return fail("Connection is not established");
+  }
+  if (options.slotName.empty() || options.publications.empty()) {
+    return fail("Slot name and at least one publication are required");
+  }
+  if (options.createSlot && !createSlot()) {
+    return false;
+  }
+  PGconn *conn = connection.getRawConnection();
+  std::string publications;
+  for (const auto &publication : options.publications) {
+    if (!publications.empty()) {
+      publications += ',';
+    }
+    publications += quoteIdentifier(conn, publication);
+  }
+  std::string command = "START_REPLICATION SLOT " +
+                        quoteIdentifier(conn, options.slotName) + " LOGICAL " +
+                        formatLsn(options.startLsn) +
+                        " (proto_version '1', publication_names " +
+                        quoteLiteral(conn, publications) + ")";
+  PGresult *result = PQexec(conn, command.c_str());
+  bool success = PQresultStatus(result) == PGRES_COPY_BOTH;
+  PQclear(result);
+  if (!success) {
+    return fail("Failed to start replication: " + connection.getLastError());
+  }
+  streaming = true;
+  receivedLsn = std::max(receivedLsn, options.startLsn);
+  acknowledgedLsn = std::max(acknowledgedLsn, options.startLsn);
+  lastStatus = std::chrono::steady_clock::now();
+  return true;
+}
+
+bool PostgreSQLChangeStream::next(ChangeEvent &event,
+                                  std::chrono::milliseconds timeout) {
+  lastError.clear();
+  if (!streaming) {
+    return fail("Change stream is not started");
+  }
+  PGconn *conn = connection.getRawConnection();
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (true) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastStatus >= options.statusInterval && !sendStatus()) {
+      return false;
+    }
+    char *buffer = nullptr;
+    int length = PQgetCopyData(conn, &buffer, 1);
+    if (length > 0) {
+      bool produced = false;
+      bool ok = handleCopyData(buffer, length, event, produced);
+      PQfreemem(buffer);
+      if (!ok) {
+        return false;
+      }
+      if (produced) {
+        return true;
+      }
+      continue;
+    }
+    if (length == -1) {
+      // The server ended the stream; collect the final status.
+      streaming = false;
+      std::string message = "Replication stream ended";
+      while (PGresult *result = PQgetResult(conn)) {
+        if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+          message += ": " + connection.getLastError();
+        }
+        PQclear(result);
+      }
+      return fail(message);
+    }
+    if (length == -2) {
+      return fail("Failed to read replication data: " +
+                  connection.getLastError());
+    }
+    if (now >= deadline) {
+      return false;
+    }
+    // Wake up for whichever comes first: the caller's deadline or the next
+    // status update.
+    auto wakeup = std::min(deadline, lastStatus + options.statusInterval);
+    auto waitMs =
+        std::chrono::ceil<std::chrono::milliseconds>(wakeup - now).count();
+    pollfd descriptor{PQsocket(conn), POLLIN, 0};
+    if (poll(&descriptor, 1, static_cast<int>(std::max<long long>(waitMs, 0))) <
+            0 &&
+        errno != EINTR) {
+      return fail(std::string("poll failed: ") + std::strerror(errno));
+    }
+    if (!PQconsumeInput(conn)) {
+      return fail("Connection lost: " + connection.getLastError());
+    }
+  }
+}
+
+bool PostgreSQLChangeStream::handleCopyData(const char *data, size_t size,
+                                            ChangeEvent &event,
+                                            bool &produced) {
+  MessageReader reader(data, size);
+  char kind = static_cast<char>(reader.readUint8());
+  if (kind == 'k') {
+    // Primary keepalive: walEnd, sendTime, replyRequested.
+    uint64_t walEnd = reader.readUint64();
+    reader.readUint64();
+    bool replyRequested = reader.readUint8() != 0;
+    if (!reader.good()) {
+      return fail("Malformed keepalive message");
+    }
+    // Outside a transaction with everything acknowledged there is nothing
+    // left to replay before walEnd, so the slot may move past WAL that
+    // did not touch our publications.
+    if (currentXid == 0 && acknowledgedLsn >= receivedLsn &&
+        walEnd > acknowledgedLsn) {
+      acknowledgedLsn = walEnd;
+    }
+    receivedLsn = std::max(receivedLsn, walEnd);
+    return !replyRequested || sendStatus();
+  }
+  if (kind == 'w') {
+    // XLogData: dataStart, walEnd, sendTime, then the pgoutput message.
+    uint64_t walStart = reader.readUint64();
+    reader.readUint64();
+    reader.readUint64();
+    if (!reader.good()) {
+      return fail("Malformed XLogData message");
+    }
+    receivedLsn = std::max(receivedLsn, walStart);
+    constexpr size_t headerSize = 1 + 3 * sizeof(uint64_t);
+    return decode(data + headerSize, size - headerSize, walStart, event,
+                  produced);
+  }
+  // Unknown message types are ignored for forward compatibility.
+  return true;
+}
+
+static bool readTuple(MessageReader &reader,
+                      const std::vector<ChangeColumn> &layout,
+                      std::vector<ChangeColumn> &tuple) {
+  uint16_t count = reader.readUint16();
+  tuple.clear();
+  tuple.reserve(count);
+  for (uint16_t i = 0; i < count && reader.good(); ++i) {
+    ChangeColumn column = i < layout.size() ? layout[i] : ChangeColumn{};
+    char kind = static_cast<char>(reader.readUint8());
+    if (kind == 'n') {
+      column.isNull = true;
+    } else if (kind == 'u') {
+      column.isUnchanged = true;
+    } else if (kind == 't' || kind == 'b') {
+      column.value = reader.readBytes(reader.readUint32());
+    } else {
+      return false;
+    }
+    tuple.push_back(std::move(column));
+  }
+  return reader.good();
+}
+
+bool PostgreSQLChangeStream::decode(const char *data, size_t size,
+                                    uint64_t walStart, ChangeEvent &event,
+                                    bool &produced) {
+  MessageReader reader(data, size);
+  char kind = static_cast<char>(reader.readUint8());
+  ChangeEvent decoded{};
+  decoded.lsn = walStart;
+  decoded.xid = currentXid;
+  decoded.commitTime = currentCommitTime;
+
+  auto findRelation = [this](uint32_t id) -> const Relation * {
+    auto it = relations.find(id);
+    return it == relations.end() ? nullptr : &it->second;
+  };
+  auto columnLayout = [](const Relation &relation) {
+    std::vector<ChangeColumn> layout;
+    layout.reserve(relation.columns.size());
+    for (const auto &column : relation.columns) {
+      layout.push_back(
+          {column.name, column.typeOid, column.isKey, false, false, ""});
+    }
+    return layout;
+  };
+
+  switch (kind) {
+  case 'B': {
+    reader.readUint64(); // final LSN
+    currentCommitTime =
+        fromPostgresTime(static_cast<int64_t>(reader.readUint64()));
+    currentXid = reader.readUint32();
+    decoded.type = ChangeType::Begin;
+    decoded.xid = currentXid;
+    decoded.commitTime = currentCommitTime;
+    break;
+  }
+  case 'C': {
+    reader.readUint8(); // flags
+    reader.readUint64(); // commit LSN
+    decoded.type = ChangeType::Commit;
+    decoded.lsn = reader.readUint64(); // end LSN
+    decoded.commitTime =
+        fromPostgresTime(static_cast<int64_t>(reader.readUint64()));
+    currentXid = 0;
+    break;
+  }
+  case 'R': {
+    uint32_t id = reader.readUint32();
+    Relation relation;
+    relation.schema = reader.readString();
+    relation.table = reader.readString();
+    reader.readUint8(); // replica identity
+    uint16_t count = reader.readUint16();
+    for (uint16_t i = 0; i < count && reader.good(); ++i) {
+      RelationColumn column;
+      column.isKey = (reader.readUint8() & 1) != 0;
+      column.name = reader.readString();
+      column.typeOid = reader.readUint32();
+      reader.readUint32(); // type modifier
+      relation.columns.push_back(std::move(column));
+    }
+    if (!reader.good()) {
+      return fail("Malformed relation message");
+    }
+    relations[id] = std::move(relation);
+    return true;
+  }
+  case 'I':
+  case 'U':
+  case 'D': {
+    const Relation *relation = findRelation(reader.readUint32());
+    if (!relation) {
+      return fail("Change for a relation that was never described");
+    }
+    decoded.type = kind == 'I'   ? ChangeType::Insert
+                   : kind == 'U' ? ChangeType::Update
+                                 : ChangeType::Delete;
+    decoded.schema = relation->schema;
+    decoded.table = relation->table;
+    std::vector<ChangeColumn> layout = columnLayout(*relation);
+    char marker = static_cast<char>(reader.readUint8());
+    if (kind == 'D' && marker != 'K' && marker != 'O') {
+      return fail("Malformed delete message");
+    }
+    if (marker == 'K' || marker == 'O') {
+      if (!readTuple(reader, layout, decoded.oldTuple)) {
+        return fail("Malformed tuple data");
+      }
+      if (kind == 'U') {
+        marker = static_cast<char>(reader.readUint8());
+      }
+    }
+    if (kind != 'D') {
+      if (marker != 'N' || !readTuple(reader, layout, decoded.newTuple)) {
+        return fail("Malformed tuple data");
+      }
+    }
+    break;
+  }
+  case 'T': {
+    uint32_t count = reader.readUint32();
+    reader.readUint8(); // CASCADE / RESTART IDENTITY flags
+    decoded.type = ChangeType::Truncate;
+    for (uint32_t i = 0; i < count && reader.good(); ++i) {
+      const Relation *relation = findRelation(reader.readUint32());
+      if (relation) {
+        decoded.truncatedTables.push_back(relation->schema + "." +
+                                          relation->table);
+      }
+    }
+    break;
+  }
+  default:
+    // Origin, type and logical decoding messages carry nothing we report.
+    return true;
+  }
+  if (!reader.good()) {
+    return fail(std::string("Malformed '") + kind + "' message");
+  }
+  event = std::move(decoded);
+  produced = true;
+  return true;
+}
+
+void PostgreSQLChangeStream::acknowledge(uint64_t lsn) {
+  acknowledgedLsn = std::max(acknowledgedLsn, lsn);
+}
+
+bool PostgreSQLChangeStream::sendStatus(bool replyRequested) {
+  if (!streaming) {
+    return false;
+  }
+  // Standby status update: write, flush and apply positions, client time.
+  char message[1 + 4 * sizeof(uint64_t) + 1];
+  message[0] = 'r';
+  putUint64(message + 1, receivedLsn);
+  putUint64(message + 9, acknowledgedLsn);
+  putUint64(message + 17, acknowledgedLsn);
+  putUint64(message + 25, static_cast<uint64_t>(postgresNow()));
+  message[33] = replyRequested ? 1 : 0;
+  PGconn *conn = connection.getRawConnection();
+  if (PQputCopyData(conn, message, sizeof(message)) <= 0 || PQflush(conn)) {
+    return fail("Failed to send status update: " + connection.getLastError());
+  }
+  lastStatus = std::chrono::steady_clock::now();
+  return true;
+}
+
+bool PostgreSQLChangeStream::stop(std::chrono::milliseconds timeout) {
+  if (!streaming) {
+    return true;
+  }
+  sendStatus();
+  streaming = false;
+  PGconn *conn = connection.getRawConnection();
+  if (PQputCopyEnd(conn, nullptr) <= 0 || PQflush(conn)) {
+    return fail("Failed to end replication: " + connection.getLastError());
+  }
+  // Drain whatever the server sent before it saw our CopyDone, without
+  // blocking past the deadline if the server never answers.
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  int length;
+  while (true) {
+    char *buffer = nullptr;
+    length = PQgetCopyData(conn, &buffer, 1);
+    if (length > 0) {
+      PQfreemem(buffer);
+      continue;
+    }
+    if (length != 0) {
+      break;
+    }
+    auto waitMs = std::chrono::ceil<std::chrono::milliseconds>(
+                      deadline - std::chrono::steady_clock::now())
+                      .count();
+    if (waitMs <= 0) {
+      break;
+    }
+    pollfd descriptor{PQsocket(conn), POLLIN, 0};
+    if (poll(&descriptor, 1, static_cast<int>(waitMs)) < 0 && errno != EINTR) {
+      return fail(std::string("poll failed: ") + std::strerror(errno));
+    }
+    if (!PQconsumeInput(conn)) {
+      return fail("Connection lost: " + connection.getLastError());
+    }
+  }
+  bool success = length == -1;
+  while (success) {
+    if (!connection.waitForResult(deadline)) {
+      success = false;
+      break;
+    }
+    PGresult *result = PQgetResult(conn);
+    if (!result) {
+      break;
+    }
+    success = PQresultStatus(result) == PGRES_COMMAND_OK;
+    PQclear(result);
+  }
+  if (!success) {
+    std::string message =
+        length == 0 ? "Timed out ending replication"
+                    : "Replication did not end cleanly: " +
+                          connection.getLastError();
+    // The connection is still in COPY mode; start over with a fresh one.
+    connection.reset();
+    return fail(message);
+  }
+  return true;
+}
+
+bool PostgreSQLChangeStream::isStreaming() const { return streaming; }
+
+bool PostgreSQLChangeStream::hasError() const { return !lastError.empty(); }
+
+const std::string &PostgreSQLChangeStream::getLastError() const {
+  return lastError;
+}
+
+uint64_t PostgreSQLChangeStream::getReceivedLsn() const { return receivedLsn; }
+
+uint64_t PostgreSQLChangeStream::getAcknowledgedLsn() const {
+  return acknowledgedLsn;
+}
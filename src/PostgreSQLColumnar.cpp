@@ -0,0 +1,464 @@
+#include "../include/PostgreSQLColumnar.h"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <thread>
+
+namespace {
+
+// Below this many rows per thread, spawning threads costs more than it saves.
+constexpr size_t MinRowsPerThread = 32768;
+constexpr int64_t PostgresEpochOffsetUs = 946684800000000LL;
+
+constexpr Oid BoolOid = 16;
+constexpr Oid Int8Oid = 20;
+constexpr Oid Int2Oid = 21;
+constexpr Oid Int4Oid = 23;
+constexpr Oid OidOid = 26;
+constexpr Oid Float4Oid = 700;
+constexpr Oid Float8Oid = 701;
+constexpr Oid TimestampOid = 1114;
+constexpr Oid TimestampTzOid = 1184;
+
+struct RangeStats {
+  std::vector<size_t> nulls;
+  std::vector<size_t> errors;
+  // Bytes of string data per column in this range.
+  std::vector<int64_t> stringBytes;
+};
+
+uint64_t readBigEndian(const char *data, size_t bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    value = (value << 8) | static_cast<unsigned char>(data[i]);
+  }
+  return value;
+}
+
+// Days from 1970-01-01 to the given proleptic Gregorian date.
+int64_t daysFromCivil(int64_t year, unsigned month, unsigned day) {
+  year -= month <= 2;
+  int64_t era = (year >= 0 ? year : year - 399) / 400;
+  unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+  unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  unsigned dayOfEra =
+      yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+}
+
+template <typename T>
+bool parseNumber(const char *&cursor, const char *end, T &value) {
+  auto [next, error] = std::from_chars(cursor, end, value);
+  if (error != std::errc()) {
+    return false;
+  }
+  cursor = next;
+  return true;
+}
+
+bool expect(const char *&cursor, const char *end, char c) {
+  if (cursor == end || *cursor != c) {
+    return false;
+  }
+  ++cursor;
+  return true;
+}
+
+unsigned daysInMonth(int64_t year, unsigned month) {
+  static constexpr unsigned days[] = {31, 28, 31, 30, 31, 30,
+                                      31, 31, 30, 31, 30, 31};
+  bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+  return month == 2 && leap ? 29 : days[month - 1];
+}
+
+// ISO DateStyle output: "YYYY-MM-DD HH:MM:SS[.ffffff][+HH[:MM[:SS]]]".
+// Out-of-range fields and values that do not fit in int64 microseconds
+// fail, so the caller counts them as conversion errors.
+bool parseTimestamp(const char *text, size_t length, int64_t &micros) {
+  std::string_view view(text, length);
+  if (view == "infinity") {
+    micros = std::numeric_limits<int64_t>::max();
+    return true;
+  }
+  if (view == "-infinity") {
+    micros = std::numeric_limits<int64_t>::min();
+    return true;
+  }
+  const char *cursor = text;
+  const char *end = text + length;
+  int64_t year;
+  unsigned month, day, hour, minute, second;
+  if (!parseNumber(cursor, end, year) || !expect(cursor, end, '-') ||
+      !parseNumber(cursor, end, month) || !expect(cursor, end, '-') ||
+      !parseNumber(cursor, end, day) || cursor == end ||
+      (*cursor != ' ' && *cursor != 'T')) {
+    return false;
+  }
+  ++cursor;
+  if (!parseNumber(cursor, end, hour) || !expect(cursor, end, ':') ||
+      !parseNumber(cursor, end, minute) || !expect(cursor, end, ':') ||
+      !parseNumber(cursor, end, second)) {
+    return false;
+  }
+  int64_t fraction = 0;
+  if (cursor != end && *cursor == '.') {
+    int digits = 0;
+    for (++cursor; cursor != end && *cursor >= '0' && *cursor <= '9';
+         ++cursor) {
+      if (digits++ < 6) {
+        fraction = fraction * 10 + (*cursor - '0');
+      }
+    }
+    for (; digits < 6; ++digits) {
+      fraction *= 10;
+    }
+  }
+  int64_t offsetSeconds = 0;
+  if (cursor != end && (*cursor == '+' || *cursor == '-')) {
+    int sign = *cursor++ == '-' ? -1 : 1;
+    unsigned part;
+    if (!parseNumber(cursor, end, part)) {
+      return false;
+    }
+    // PostgreSQL accepts zone offsets up to 15:59:59.
+    if (part > 15) {
+      return false;
+    }
+    offsetSeconds = part * 3600;
+    for (int multiplier : {60, 1}) {
+      if (cursor == end || *cursor != ':') {
+        break;
+      }
+      ++cursor;
+      if (!parseNumber(cursor, end, part) || part > 59) {
+        return false;
+      }
+      offsetSeconds += part * multiplier;
+    }
+    offsetSeconds *= sign;
+  }
+  // Anything left over (" BC", another DateStyle) is not understood.
+  // Years beyond PostgreSQL's own range would also overflow daysFromCivil.
+  if (cursor != end || year < 1 || year > 294277 || month < 1 ||
+      month > 12 || day < 1 || day > daysInMonth(year, month) || hour > 23 ||
+      minute > 59 || second > 59) {
+    return false;
+  }
+  int64_t timeOfDay =
+      static_cast<int64_t>(hour) * 3600 + minute * 60 + second - offsetSeconds;
+  int64_t seconds;
+  return !__builtin_mul_overflow(daysFromCivil(year, month, day),
+                                 int64_t{86400}, &seconds) &&
+         !__builtin_add_overflow(seconds, timeOfDay, &seconds) &&
+         !__builtin_mul_overflow(seconds, int64_t{1000000}, &micros) &&
+         !__builtin_add_overflow(micros, fraction, &micros);
+}
+
+bool parseDouble(const char *text, size_t length, double &value) {
+  std::string_view view(text, length);
+  if (view == "NaN") {
+    value = std::numeric_limits<double>::quiet_NaN();
+    return true;
+  }
+  if (view == "Infinity" || view == "-Infinity") {
+    value = view[0] == '-' ? -std::numeric_limits<double>::infinity()
+                           : std::numeric_limits<double>::infinity();
+    return true;
+  }
+  auto [next, error] = std::from_chars(text, text + length, value);
+  return error == std::errc() && next == text + length;
+}
+
+bool decodeInt64(const char *value, size_t length, bool binary, Oid typeOid,
+                 int64_t &out) {
+  if (binary) {
+    if (typeOid == Int2Oid && length == 2) {
+      out = static_cast<int16_t>(readBigEndian(value, 2));
+    } else if (typeOid == Int4Oid && length == 4) {
+      out = static_cast<int32_t>(readBigEndian(value, 4));
+    } else if (typeOid == OidOid && length == 4) {
+      out = static_cast<uint32_t>(readBigEndian(value, 4));
+    } else if (typeOid == Int8Oid && length == 8) {
+      out = static_cast<int64_t>(readBigEndian(value, 8));
+    } else {
+      return false;
+    }
+    return true;
+  }
+  auto [next, error] = std::from_chars(value, value + length, out);
+  return error == std::errc() && next == value + length;
+}
+
+bool decodeFloat64(const char *value, size_t length, bool binary,
+                   double &out) {
+  if (!binary) {
+    return parseDouble(value, length, out);
+  }
+  if (length == 4) {
+    out = std::bit_cast<float>(static_cast<uint32_t>(readBigEndian(value, 4)));
+  } else if (length == 8) {
+    out = std::bit_cast<double>(readBigEndian(value, 8));
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool decodeTimestamp(const char *value, size_t length, bool binary,
+                     int64_t &out) {
+  if (!binary) {
+    return parseTimestamp(value, length, out);
+  }
+  if (length != 8) {
+    return false;
+  }
+  out = static_cast<int64_t>(readBigEndian(value, 8));
+  if (out == std::numeric_limits<int64_t>::max() ||
+      out == std::numeric_limits<int64_t>::min()) {
+    return true; // infinity / -infinity
+  }
+  // Not representable relative to the Unix epoch; counted as an error.
+  if (out > std::numeric_limits<int64_t>::max() - PostgresEpochOffsetUs) {
+    return false;
+  }
+  out += PostgresEpochOffsetUs;
+  return true;
+}
+
+// Failed conversions may have written a partial value.
+void clearSlot(ColumnArray &column, size_t row) {
+  switch (column.type) {
+  case ColumnType::Int64:
+  case ColumnType::Timestamp:
+    column.int64Values[row] = 0;
+    break;
+  case ColumnType::Float64:
+    column.float64Values[row] = 0.0;
+    break;
+  case ColumnType::Bool:
+    column.boolValues[row] = 0;
+    break;
+  case ColumnType::String:
+    break;
+  }
+}
+
+// First pass over [begin, end): fixed-width columns are decoded in full,
+// string columns only record their lengths in offsets[row + 1].
+void decodeRange(PGresult *result, std::vector<ColumnArray> &columns,
+                 size_t begin, size_t end, RangeStats &stats) {
+  for (size_t col = 0; col < columns.size(); ++col) {
+    ColumnArray &column = columns[col];
+    int field = static_cast<int>(col);
+    bool binary = PQfformat(result, field) == 1;
+    size_t nulls = 0;
+    size_t errors = 0;
+    int64_t bytes = 0;
+    for (size_t row = begin; row < end; ++row) {
+      int tuple = static_cast<int>(row);
+      if (PQgetisnull(result, tuple, field)) {
+        ++nulls;
+        if (column.type == ColumnType::String) {
+          column.offsets[row + 1] = 0;
+        }
+        continue;
+      }
+      const char *value = PQgetvalue(result, tuple, field);
+      size_t length = static_cast<size_t>(PQgetlength(result, tuple, field));
+      bool ok = true;
+      switch (column.type) {
+      case ColumnType::Int64:
+        ok = decodeInt64(value, length, binary, column.typeOid,
+                         column.int64Values[row]);
+        break;
+      case ColumnType::Float64:
+        ok = decodeFloat64(value, length, binary, column.float64Values[row]);
+        break;
+      case ColumnType::Bool:
+        ok = length == 1 && (binary || *value == 't' || *value == 'f');
+        column.boolValues[row] = binary ? *value != 0 : *value == 't';
+        break;
+      case ColumnType::Timestamp:
+        ok = decodeTimestamp(value, length, binary, column.int64Values[row]);
+        break;
+      case ColumnType::String:
+        column.offsets[row + 1] = static_cast<int64_t>(length);
+        bytes += static_cast<int64_t>(length);
+        break;
+      }
+      if (!ok) {
+        clearSlot(column, row);
+        ++errors;
+        ++nulls;
+        continue;
+      }
+      column.validity[row >> 3] |= static_cast<uint8_t>(1u << (row & 7));
+    }
+    stats.nulls[col] = nulls;
+    stats.errors[col] = errors;
+    stats.stringBytes[col] = bytes;
+  }
+}
+
+// Second pass: turn the lengths into absolute offsets starting at each
+// column's base for this range and copy the bytes. offsets[begin] belongs
+// to the previous range and is never written here.
+void copyStrings(PGresult *result, std::vector<ColumnArray> &columns,
+                 size_t begin, size_t end, const std::vector<int64_t> &bases) {
+  for (size_t col = 0; col < columns.size(); ++col) {
+    ColumnArray &column = columns[col];
+    if (column.type != ColumnType::String) {
+      continue;
+    }
+    int field = static_cast<int>(col);
+    int64_t position = bases[col];
+    for (size_t row = begin; row < end; ++row) {
+      int64_t length = column.offsets[row + 1];
+      if (length > 0) {
+        std::memcpy(column.data.data() + position,
+                    PQgetvalue(result, static_cast<int>(row), field), length);
+      }
+      position += length;
+      column.offsets[row + 1] = position;
+    }
+  }
+}
+
+template <typename Work>
+void runRanges(const std::vector<std::pair<size_t, size_t>> &ranges,
+               Work work) {
+  if (ranges.size() == 1) {
+    work(0);
+    return;
+  }
+  std::vector<std::thread> threads;
+  size_t started = 1;
+  try {
+    threads.reserve(ranges.size() - 1);
+    for (; started < ranges.size(); ++started) {
+      threads.emplace_back(work, started);
+    }
+  } catch (const std::exception &) {
+    // Out of threads or memory: the ranges not handed off run here.
+  }
+  for (size_t i = started; i < ranges.size(); ++i) {
+    work(i);
+  }
+  work(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+} // namespace
+
+ColumnType PostgreSQLColumnar::columnTypeFor(Oid typeOid) {
+  switch (typeOid) {
+  case Int2Oid:
+  case Int4Oid:
+  case Int8Oid:
+  case OidOid:
+    return ColumnType::Int64;
+  case Float4Oid:
+  case Float8Oid:
+    return ColumnType::Float64;
+  case BoolOid:
+    return ColumnType::Bool;
+  case TimestampOid:
+  case TimestampTzOid:
+    return ColumnType::Timestamp;
+  default:
+    // numeric stays a string so no precision is lost.
+    return ColumnType::String;
+  }
+}
+
+ColumnarResult PostgreSQLColumnar::decode(PGresult *result,
+                                          size_t threadCount) {
+  ColumnarResult columnar;
+  if (!result || PQresultStatus(result) != PGRES_TUPLES_OK) {
+    columnar.errorMessage = "Result does not contain rows";
+    return columnar;
+  }
+  size_t rowCount = static_cast<size_t>(PQntuples(result));
+  int colCount = PQnfields(result);
+  columnar.rowCount = rowCount;
+  columnar.columns.resize(colCount);
+  for (int col = 0; col < colCount; ++col) {
+    ColumnArray &column = columnar.columns[col];
+    column.name = PQfname(result, col);
+    column.typeOid = PQftype(result, col);
+    column.type = columnTypeFor(column.typeOid);
+    column.length = rowCount;
+    column.validity.assign((rowCount + 7) / 8, 0);
+    switch (column.type) {
+    case ColumnType::Int64:
+    case ColumnType::Timestamp:
+      column.int64Values.assign(rowCount, 0);
+      break;
+    case ColumnType::Float64:
+      column.float64Values.assign(rowCount, 0.0);
+      break;
+    case ColumnType::Bool:
+      column.boolValues.assign(rowCount, 0);
+      break;
+    case ColumnType::String:
+      column.offsets.assign(rowCount + 1, 0);
+      break;
+    }
+  }
+
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threadCount = std::clamp<size_t>(rowCount / MinRowsPerThread, 1, threadCount);
+  // Range boundaries are multiples of 64 rows, so each validity byte (and
+  // 64-bit word) is owned by exactly one thread.
+  size_t rowsPerRange = (rowCount + threadCount - 1) / threadCount;
+  rowsPerRange = (rowsPerRange + 63) / 64 * 64;
+  std::vector<std::pair<size_t, size_t>> ranges;
+  for (size_t begin = 0; begin < rowCount || ranges.empty();
+       begin += rowsPerRange) {
+    ranges.emplace_back(begin, std::min(rowCount, begin + rowsPerRange));
+  }
+
+  std::vector<RangeStats> stats(ranges.size());
+  for (auto &rangeStats : stats) {
+    rangeStats.nulls.assign(colCount, 0);
+    rangeStats.errors.assign(colCount, 0);
+    rangeStats.stringBytes.assign(colCount, 0);
+  }
+  runRanges(ranges, [&](size_t i) {
+    decodeRange(result, columnar.columns, ranges[i].first, ranges[i].second,
+                stats[i]);
+  });
+
+  // Prefix sum of per-range string sizes gives every range its write base.
+  std::vector<std::vector<int64_t>> bases(ranges.size(),
+                                          std::vector<int64_t>(colCount, 0));
+  bool hasStrings = false;
+  for (int col = 0; col < colCount; ++col) {
+    ColumnArray &column = columnar.columns[col];
+    int64_t total = 0;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      column.nullCount += stats[i].nulls[col];
+      column.conversionErrors += stats[i].errors[col];
+      bases[i][col] = total;
+      total += stats[i].stringBytes[col];
+    }
+    if (column.type == ColumnType::String) {
+      column.data.resize(static_cast<size_t>(total));
+      hasStrings = true;
+    }
+  }
+  if (hasStrings) {
+    runRanges(ranges, [&](size_t i) {
+      copyStrings(result, columnar.columns, ranges[i].first, ranges[i].second,
+                  bases[i]);
+    });
+  }
+  return columnar;
+}
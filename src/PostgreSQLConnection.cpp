@@ -1,10 +1,14 @@
 #include "../include/PostgreSQLConnection.h"
+#include "../include/PostgreSQLTrace.h"
+#include <cerrno>
 #include <iostream>
+#include <poll.h>
 
-PostgreSQLConnection::PostgreSQLConnection() : connection(nullptr) {}
+PostgreSQLConnection::PostgreSQLConnection()
+    : connection(nullptr), cancelHandle(nullptr) {}
 
 PostgreSQLConnection::PostgreSQLConnection(const std::string &conninfo)
-    : connection(nullptr) {
+    : connection(nullptr), cancelHandle(nullptr) {
   connect(conninfo);
 }
 
@@ -12,21 +16,28 @@ PostgreSQLConnection::~PostgreSQLConnection() { disconnect(); }
 
 PostgreSQLConnection::PostgreSQLConnection(
     PostgreSQLConnection &&other) noexcept
-    : connection(other.connection) {
+    : connection(other.connection), cancelHandle(nullptr) {
+  std::lock_guard<std::mutex> lock(other.cancelMutex);
+  cancelHandle = other.cancelHandle;
   other.connection = nullptr;
+  other.cancelHandle = nullptr;
 }
 
 PostgreSQLConnection &
 PostgreSQLConnection::operator=(PostgreSQLConnection &&other) noexcept {
   if (this != &other) {
     disconnect();
+    std::scoped_lock lock(cancelMutex, other.cancelMutex);
     connection = other.connection;
+    cancelHandle = other.cancelHandle;
     other.connection = nullptr;
+    other.cancelHandle = nullptr;
   }
   return *this;
 }
 
 bool PostgreSQLConnection::connect(const std::string &conninfo) {
+  PQXX_TRACE_SPAN("connect", "connection");
   disconnect();
   connection = PQconnectdb(conninfo.c_str());
   if (PQstatus(connection) != CONNECTION_OK) {
@@ -36,11 +47,22 @@ bool PostgreSQLConnection::connect(const std::string &conninfo) {
     connection = nullptr;
     return false;
   }
+  {
+    std::lock_guard<std::mutex> lock(cancelMutex);
+    cancelHandle = PQgetCancel(connection);
+  }
   std::cout << "Connected to database successfully!" << std::endl;
   return true;
 }
 
 void PostgreSQLConnection::disconnect() {
+  {
+    std::lock_guard<std::mutex> lock(cancelMutex);
+    if (cancelHandle) {
+      PQfreeCancel(cancelHandle);
+      cancelHandle = nullptr;
+    }
+  }
   if (connection) {
     PQfinish(connection);
     connection = nullptr;
@@ -65,6 +87,7 @@ std::string PostgreSQLConnection::getLastError() const {
 bool PostgreSQLConnection::beginTransaction() {
   if (!isOK())
     return false;
+  PQXX_TRACE_SPAN("transaction.begin", "transaction");
   PGresult *result = PQexec(connection, "BEGIN");
   bool success = (PQresultStatus(result) == PGRES_COMMAND_OK);
   PQclear(result);
@@ -74,6 +97,7 @@ bool PostgreSQLConnection::beginTransaction() {
 bool PostgreSQLConnection::commitTransaction() {
   if (!isOK())
     return false;
+  PQXX_TRACE_SPAN("transaction.commit", "transaction");
   PGresult *result = PQexec(connection, "COMMIT");
   bool success = (PQresultStatus(result) == PGRES_COMMAND_OK);
   PQclear(result);
@@ -83,6 +107,7 @@ bool PostgreSQLConnection::commitTransaction() {
 bool PostgreSQLConnection::rollbackTransaction() {
   if (!isOK())
     return false;
+  PQXX_TRACE_SPAN("transaction.rollback", "transaction");
   PGresult *result = PQexec(connection, "ROLLBACK");
   bool success = (PQresultStatus(result) == PGRES_COMMAND_OK);
   PQclear(result);
@@ -92,3 +117,74 @@ bool PostgreSQLConnection::rollbackTransaction() {
 ConnStatusType PostgreSQLConnection::getStatus() const {
   return connection ? PQstatus(connection) : CONNECTION_BAD;
 }
+
+bool PostgreSQLConnection::cancel() {
+  std::lock_guard<std::mutex> lock(cancelMutex);
+  if (!cancelHandle)
+    return false;
+  char errorBuffer[256];
+  if (!PQcancel(cancelHandle, errorBuffer, sizeof(errorBuffer))) {
+    std::cerr << "Cancel request failed: " << errorBuffer << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool PostgreSQLConnection::waitForResult(
+    std::chrono::steady_clock::time_point deadline) {
+  if (!connection)
+    return false;
+  while (true) {
+    if (!PQconsumeInput(connection))
+      return false;
+    if (!PQisBusy(connection))
+      return true;
+    int timeoutMs = -1;
+    if (deadline != std::chrono::steady_clock::time_point::max()) {
+      auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      if (remaining.count() <= 0)
+        return false;
+      timeoutMs = static_cast<int>(remaining.count());
+    }
+    pollfd descriptor{PQsocket(connection), POLLIN, 0};
+    int ready = poll(&descriptor, 1, timeoutMs);
+    if (ready < 0 && errno != EINTR)
+      return false;
+  }
+}
+
+DrainResult
+PostgreSQLConnection::discardResults(std::chrono::milliseconds grace) {
+  if (!connection)
+    return DrainResult::Failed;
+  auto deadline = std::chrono::steady_clock::now() + grace;
+  bool copying = false;
+  while (!copying) {
+    if (!waitForResult(deadline)) {
+      std::cerr << "Server did not answer the cancel, resetting connection"
+                << std::endl;
+      break;
+    }
+    PGresult *result = PQgetResult(connection);
+    if (!result)
+      return DrainResult::Drained;
+    ExecStatusType status = PQresultStatus(result);
+    PQclear(result);
+    copying = status == PGRES_COPY_IN || status == PGRES_COPY_OUT ||
+              status == PGRES_COPY_BOTH;
+  }
+  return reset() ? DrainResult::Reset : DrainResult::Failed;
+}
+
+bool PostgreSQLConnection::reset() {
+  if (!connection)
+    return false;
+  PQreset(connection);
+  std::lock_guard<std::mutex> lock(cancelMutex);
+  if (cancelHandle) {
+    PQfreeCancel(cancelHandle);
+  }
+  cancelHandle = PQgetCancel(connection);
+  return PQstatus(connection) == CONNECTION_OK;
+}
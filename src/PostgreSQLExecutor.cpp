@@ -0,0 +1,199 @@
+#include "../include/PostgreSQLExecutor.h"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+// The executor whose worker loop runs on this thread, if any.
+thread_local const PostgreSQLExecutor *currentExecutor = nullptr;
+
+} // namespace
+
+PostgreSQLExecutor::PostgreSQLExecutor(const std::string &conninfo,
+                                       size_t workerCount,
+                                       size_t queueCapacity)
+    : nextWorker(0), stolenTasks(0), sleepingWorkers(0), wakeEpoch(0),
+      activeSubmitters(0), stopping(false), stopped(false) {
+  if (workerCount == 0) {
+    workerCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < workerCount; ++i) {
+    auto worker = std::make_unique<Worker>(conninfo, queueCapacity);
+    if (!worker->connection.isOK()) {
+      throw std::runtime_error("Executor worker failed to connect: " +
+                               worker->connection.getLastError());
+    }
+    workers.push_back(std::move(worker));
+  }
+  try {
+    for (size_t i = 0; i < workers.size(); ++i) {
+      workers[i]->thread =
+          std::thread(&PostgreSQLExecutor::workerLoop, this, i);
+    }
+  } catch (...) {
+    // The destructor will not run; stop the workers that did start.
+    shutdown();
+    throw;
+  }
+}
+
+PostgreSQLExecutor::~PostgreSQLExecutor() { shutdown(); }
+
+bool PostgreSQLExecutor::onWorkerThread() const {
+  return currentExecutor == this;
+}
+
+void PostgreSQLExecutor::shutdown() {
+  // Joining would wait for the calling task itself.
+  if (onWorkerThread()) {
+    throw std::logic_error("Executor cannot be shut down from its own task");
+  }
+  stopping.store(true);
+  // A submitter that passed the stopping check is still allowed to queue
+  // its task, and the workers must see it before they exit.
+  while (activeSubmitters.load() > 0) {
+    std::this_thread::yield();
+  }
+  stopped.store(true);
+  wakeEpoch.fetch_add(1);
+  wakeEpoch.notify_all();
+  for (auto &worker : workers) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+}
+
+size_t PostgreSQLExecutor::pickWorker() {
+  return nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+}
+
+size_t PostgreSQLExecutor::getWorkerCount() const { return workers.size(); }
+
+size_t PostgreSQLExecutor::getStolenCount() const {
+  return stolenTasks.load(std::memory_order_relaxed);
+}
+
+void PostgreSQLExecutor::wakeWorkers() {
+  // Pairs with the fence in workerLoop: either the sleeper sees the new task
+  // or we see the sleeper and bump the epoch it is waiting on.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleepingWorkers.load() > 0) {
+    wakeEpoch.fetch_add(1);
+    wakeEpoch.notify_all();
+  }
+}
+
+void PostgreSQLExecutor::beginSubmit() {
+  activeSubmitters.fetch_add(1);
+  if (stopping.load()) {
+    activeSubmitters.fetch_sub(1);
+    throw std::runtime_error("Executor is shut down");
+  }
+}
+
+void PostgreSQLExecutor::enqueueShared(Task task) {
+  beginSubmit();
+  size_t start = pickWorker();
+  while (true) {
+    for (size_t i = 0; i < workers.size(); ++i) {
+      if (workers[(start + i) % workers.size()]->sharedTasks.tryPush(task)) {
+        activeSubmitters.fetch_sub(1);
+        wakeWorkers();
+        return;
+      }
+    }
+    // Every queue is full: back off until workers drain something. A task
+    // of this executor would be waiting on itself.
+    if (onWorkerThread()) {
+      activeSubmitters.fetch_sub(1);
+      throw std::runtime_error("Executor queues are full");
+    }
+    std::this_thread::yield();
+  }
+}
+
+void PostgreSQLExecutor::enqueuePinned(size_t index, Task task) {
+  beginSubmit();
+  while (!workers[index]->pinnedTasks.tryPush(task)) {
+    if (onWorkerThread()) {
+      activeSubmitters.fetch_sub(1);
+      throw std::runtime_error("Executor worker queue is full");
+    }
+    std::this_thread::yield();
+  }
+  activeSubmitters.fetch_sub(1);
+  wakeWorkers();
+}
+
+bool PostgreSQLExecutor::acquireTask(size_t index, Task &task) {
+  Worker &self = *workers[index];
+  if (self.pinnedTasks.tryPop(task)) {
+    return true;
+  }
+  // Between the pinned tasks of a submitTo()/submitTransaction() sequence
+  // the connection may hold an open transaction; only pinned work may run.
+  PGTransactionStatusType status =
+      PQtransactionStatus(self.connection.getRawConnection());
+  if (status == PQTRANS_INTRANS || status == PQTRANS_INERROR) {
+    return false;
+  }
+  if (self.sharedTasks.tryPop(task)) {
+    return true;
+  }
+  for (size_t i = 1; i < workers.size(); ++i) {
+    if (workers[(index + i) % workers.size()]->sharedTasks.tryPop(task)) {
+      stolenTasks.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void PostgreSQLExecutor::workerLoop(size_t index) {
+  currentExecutor = this;
+  Worker &self = *workers[index];
+  Task task;
+  int idleSpins = 0;
+  while (true) {
+    if (!acquireTask(index, task)) {
+      // Once stopped no task can be queued any more, so one more empty
+      // look means the worker is done. A transaction still open at that
+      // point can never be finished; roll it back so the shared tasks
+      // queued here get to run.
+      if (stopped.load()) {
+        if (PQtransactionStatus(self.connection.getRawConnection()) !=
+            PQTRANS_IDLE) {
+          self.connection.rollbackTransaction();
+        }
+        if (!acquireTask(index, task)) {
+          return;
+        }
+      }
+    }
+    if (!task) {
+      if (++idleSpins < 64) {
+        std::this_thread::yield();
+        continue;
+      }
+      uint32_t epoch = wakeEpoch.load();
+      sleepingWorkers.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      bool found = acquireTask(index, task);
+      if (!found && !stopped.load()) {
+        wakeEpoch.wait(epoch);
+      }
+      sleepingWorkers.fetch_sub(1);
+      if (!found) {
+        continue;
+      }
+    }
+    idleSpins = 0;
+    try {
+      task(self.connection);
+    } catch (const std::exception &e) {
+      std::cerr << "Executor task failed: " << e.what() << std::endl;
+    }
+    task = nullptr;
+  }
+}
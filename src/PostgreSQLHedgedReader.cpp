@@ -0,0 +1,198 @@
+#include "../include/PostgreSQLHedgedReader.h"
+#include "../include/PostgreSQLParamArray.h"
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <poll.h>
+
+PostgreSQLHedgedReader::PostgreSQLHedgedReader(
+    PostgreSQLConnection &primaryConn, PostgreSQLConnection &secondaryConn,
+    size_t latencyWindow, std::chrono::microseconds initialDelay)
+    : primary(primaryConn), secondary(secondaryConn), nextSample(0),
+      initialHedgeDelay(initialDelay), minHedgeDelay(0), hedgedCount(0),
+      secondaryWins(0), primaryAbandoned(false), secondaryAbandoned(false) {
+  latencies.reserve(latencyWindow ? latencyWindow : 1);
+}
+
+PostgreSQLHedgedReader::~PostgreSQLHedgedReader() { drainAbandoned(); }
+
+void PostgreSQLHedgedReader::recordLatency(std::chrono::microseconds latency) {
+  if (latencies.size() < latencies.capacity()) {
+    latencies.push_back(latency.count());
+  } else {
+    latencies[nextSample] = latency.count();
+    nextSample = (nextSample + 1) % latencies.size();
+  }
+}
+
+std::chrono::microseconds PostgreSQLHedgedReader::getHedgeDelay() const {
+  // Too few samples for a meaningful percentile yet.
+  if (latencies.size() < 20) {
+    return std::max(initialHedgeDelay, minHedgeDelay);
+  }
+  std::vector<long long> sorted(latencies);
+  size_t index = sorted.size() * 95 / 100;
+  std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+  return std::max(std::chrono::microseconds(sorted[index]), minHedgeDelay);
+}
+
+void PostgreSQLHedgedReader::setMinHedgeDelay(std::chrono::microseconds delay) {
+  minHedgeDelay = delay;
+}
+
+size_t PostgreSQLHedgedReader::getHedgedCount() const { return hedgedCount; }
+
+size_t PostgreSQLHedgedReader::getSecondaryWins() const {
+  return secondaryWins;
+}
+
+bool PostgreSQLHedgedReader::send(PostgreSQLConnection &conn,
+                                  const std::string &query,
+                                  const std::vector<std::string> &params) {
+  if (!conn.isOK()) {
+    return false;
+  }
+  ParamArray values{std::span<const std::string>(params)};
+  return PQsendQueryParams(conn.getRawConnection(), query.c_str(),
+                           values.size(), nullptr, values.data(), nullptr,
+                           nullptr, 0) == 1;
+}
+
+PGresult *
+PostgreSQLHedgedReader::collect(PostgreSQLConnection &conn,
+                                std::chrono::steady_clock::time_point deadline) {
+  PGresult *last = nullptr;
+  while (true) {
+    if (!conn.waitForResult(deadline)) {
+      PQclear(last);
+      return nullptr;
+    }
+    PGresult *next = PQgetResult(conn.getRawConnection());
+    if (!next) {
+      return last;
+    }
+    PQclear(last);
+    last = next;
+  }
+}
+
+void PostgreSQLHedgedReader::abandon(PostgreSQLConnection &conn) {
+  conn.cancel();
+  (&conn == &primary ? primaryAbandoned : secondaryAbandoned) = true;
+}
+
+void PostgreSQLHedgedReader::drainAbandoned() {
+  for (PostgreSQLConnection *conn : {&primary, &secondary}) {
+    bool &abandoned = conn == &primary ? primaryAbandoned : secondaryAbandoned;
+    if (abandoned && conn->discardResults() == DrainResult::Reset) {
+      std::cerr << "Hedged read reset a connection to drain a cancelled read"
+                << std::endl;
+    }
+    abandoned = false;
+  }
+}
+
+PGresult *PostgreSQLHedgedReader::read(const std::string &query,
+                                       const std::vector<std::string> &params,
+                                       std::chrono::milliseconds timeout) {
+  drainAbandoned();
+  auto started = std::chrono::steady_clock::now();
+  auto deadline = timeout.count() > 0
+                      ? started + timeout
+                      : std::chrono::steady_clock::time_point::max();
+  PostgreSQLConnection *winner = nullptr;
+  PostgreSQLConnection *loser = nullptr;
+  if (!send(primary, query, params)) {
+    if (!send(secondary, query, params)) {
+      std::cerr << "Hedged read failed to send: " << primary.getLastError()
+                << std::endl;
+      return nullptr;
+    }
+    winner = &secondary;
+    ++secondaryWins;
+  }
+
+  auto hedgeAt = std::min(started + getHedgeDelay(), deadline);
+  if (winner) {
+    // Already on the secondary; there is nothing to hedge against.
+  } else if (primary.waitForResult(hedgeAt)) {
+    winner = &primary;
+  } else if (std::chrono::steady_clock::now() < deadline &&
+             send(secondary, query, params)) {
+    ++hedgedCount;
+    bool primaryActive = primary.isOK();
+    bool secondaryActive = true;
+    while (!winner && (primaryActive || secondaryActive)) {
+      pollfd descriptors[2];
+      nfds_t count = 0;
+      for (PostgreSQLConnection *conn : {&primary, &secondary}) {
+        bool &active = conn == &primary ? primaryActive : secondaryActive;
+        if (!active) {
+          continue;
+        }
+        if (!PQconsumeInput(conn->getRawConnection())) {
+          active = false;
+          continue;
+        }
+        if (!PQisBusy(conn->getRawConnection())) {
+          winner = conn;
+          break;
+        }
+        descriptors[count++] = {PQsocket(conn->getRawConnection()), POLLIN, 0};
+      }
+      if (winner || count == 0) {
+        break;
+      }
+      int timeoutMs = -1;
+      if (deadline != std::chrono::steady_clock::time_point::max()) {
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+          break;
+        }
+        timeoutMs = static_cast<int>(remaining.count());
+      }
+      if (poll(descriptors, count, timeoutMs) < 0 && errno != EINTR) {
+        break;
+      }
+    }
+    if (winner == &secondary) {
+      ++secondaryWins;
+    }
+    if (!winner) {
+      for (PostgreSQLConnection *conn : {&primary, &secondary}) {
+        if (conn->isOK()) {
+          abandon(*conn);
+        }
+      }
+      std::cerr << "Hedged read timed out or failed on both connections"
+                << std::endl;
+      return nullptr;
+    }
+    loser = winner == &primary ? &secondary : &primary;
+  } else {
+    winner = &primary;
+  }
+
+  PGresult *result = collect(*winner, deadline);
+  auto finished = std::chrono::steady_clock::now();
+  // Only cancelled now so the winner's result is not delayed by it.
+  if (loser && loser->isOK()) {
+    abandon(*loser);
+  }
+  if (!result) {
+    abandon(*winner);
+    std::cerr << "Hedged read timed out: " << query << std::endl;
+    return nullptr;
+  }
+  recordLatency(
+      std::chrono::duration_cast<std::chrono::microseconds>(finished - started));
+  ExecStatusType status = PQresultStatus(result);
+  if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
+    std::cerr << "Hedged read failed (" << PQresStatus(status)
+              << "): " << winner->getLastError() << std::endl;
+    PQclear(result);
+    return nullptr;
+  }
+  return result;
+}
@@ -0,0 +1,224 @@
+#include "../include/PostgreSQLLargeObject.h"
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <unistd.h>
+
+// lo_read/lo_write report sizes as int, so requests are capped per call.
+static constexpr size_t maxChunk = 64 * 1024 * 1024;
+
+// An empty staging buffer would make every copy look like an empty object.
+static bool checkBuffer(std::span<std::byte> buffer) {
+  if (buffer.empty()) {
+    std::cerr << "Large object copy needs a non-empty buffer" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+PostgreSQLLargeObject::PostgreSQLLargeObject(PostgreSQLConnection &conn)
+    : connection(conn), objectId(InvalidOid), descriptor(-1) {}
+
+PostgreSQLLargeObject::~PostgreSQLLargeObject() { close(); }
+
+Oid PostgreSQLLargeObject::create(PostgreSQLConnection &conn) {
+  if (!conn.isOK()) {
+    return InvalidOid;
+  }
+  Oid oid = lo_creat(conn.getRawConnection(), INV_READ | INV_WRITE);
+  if (oid == InvalidOid) {
+    std::cerr << "Large object creation failed: " << conn.getLastError()
+              << std::endl;
+  }
+  return oid;
+}
+
+bool PostgreSQLLargeObject::remove(PostgreSQLConnection &conn, Oid oid) {
+  if (!conn.isOK()) {
+    return false;
+  }
+  return lo_unlink(conn.getRawConnection(), oid) == 1;
+}
+
+bool PostgreSQLLargeObject::open(Oid oid, int mode) {
+  close();
+  if (!connection.isOK()) {
+    std::cerr << "Database connection is not OK" << std::endl;
+    return false;
+  }
+  descriptor = lo_open(connection.getRawConnection(), oid, mode);
+  if (descriptor < 0) {
+    std::cerr << "Failed to open large object " << oid << ": "
+              << connection.getLastError() << std::endl;
+    return false;
+  }
+  objectId = oid;
+  return true;
+}
+
+bool PostgreSQLLargeObject::close() {
+  if (descriptor < 0) {
+    return true;
+  }
+  bool closed = !connection.isOK() ||
+                lo_close(connection.getRawConnection(), descriptor) == 0;
+  descriptor = -1;
+  objectId = InvalidOid;
+  return closed;
+}
+
+bool PostgreSQLLargeObject::isOpen() const { return descriptor >= 0; }
+
+Oid PostgreSQLLargeObject::getOid() const { return objectId; }
+
+long long PostgreSQLLargeObject::read(std::span<std::byte> buffer) {
+  if (descriptor < 0) {
+    return -1;
+  }
+  size_t length = std::min(buffer.size(), maxChunk);
+  int count = lo_read(connection.getRawConnection(), descriptor,
+                      reinterpret_cast<char *>(buffer.data()), length);
+  return count < 0 ? -1 : count;
+}
+
+long long PostgreSQLLargeObject::write(std::span<const std::byte> data) {
+  if (descriptor < 0) {
+    return -1;
+  }
+  long long total = 0;
+  while (!data.empty()) {
+    size_t length = std::min(data.size(), maxChunk);
+    int count = lo_write(connection.getRawConnection(), descriptor,
+                         reinterpret_cast<const char *>(data.data()), length);
+    if (count < 0) {
+      std::cerr << "Large object write failed: " << connection.getLastError()
+                << std::endl;
+      return -1;
+    }
+    total += count;
+    data = data.subspan(static_cast<size_t>(count));
+  }
+  return total;
+}
+
+long long PostgreSQLLargeObject::seek(long long offset, int whence) {
+  if (descriptor < 0) {
+    return -1;
+  }
+  return lo_lseek64(connection.getRawConnection(), descriptor, offset, whence);
+}
+
+long long PostgreSQLLargeObject::tell() {
+  if (descriptor < 0) {
+    return -1;
+  }
+  return lo_tell64(connection.getRawConnection(), descriptor);
+}
+
+long long PostgreSQLLargeObject::size() {
+  long long position = tell();
+  if (position < 0) {
+    return -1;
+  }
+  long long end = seek(0, SEEK_END);
+  seek(position, SEEK_SET);
+  return end;
+}
+
+bool PostgreSQLLargeObject::truncate(long long length) {
+  if (descriptor < 0) {
+    return false;
+  }
+  return lo_truncate64(connection.getRawConnection(), descriptor, length) == 0;
+}
+
+long long PostgreSQLLargeObject::readTo(int fd, std::span<std::byte> buffer) {
+  if (!checkBuffer(buffer)) {
+    return -1;
+  }
+  long long total = 0;
+  while (true) {
+    long long count = read(buffer);
+    if (count <= 0) {
+      return count < 0 ? -1 : total;
+    }
+    const std::byte *cursor = buffer.data();
+    long long remaining = count;
+    while (remaining > 0) {
+      ssize_t written = ::write(fd, cursor, static_cast<size_t>(remaining));
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return -1;
+      }
+      cursor += written;
+      remaining -= written;
+    }
+    total += count;
+  }
+}
+
+long long PostgreSQLLargeObject::readTo(std::ostream &output,
+                                        std::span<std::byte> buffer) {
+  if (!checkBuffer(buffer)) {
+    return -1;
+  }
+  long long total = 0;
+  while (true) {
+    long long count = read(buffer);
+    if (count <= 0) {
+      return count < 0 ? -1 : total;
+    }
+    output.write(reinterpret_cast<const char *>(buffer.data()), count);
+    if (!output) {
+      return -1;
+    }
+    total += count;
+  }
+}
+
+long long PostgreSQLLargeObject::writeFrom(int fd,
+                                           std::span<std::byte> buffer) {
+  if (!checkBuffer(buffer)) {
+    return -1;
+  }
+  long long total = 0;
+  while (true) {
+    ssize_t count = ::read(fd, buffer.data(), buffer.size());
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (count == 0) {
+      return total;
+    }
+    if (write(buffer.first(static_cast<size_t>(count))) < 0) {
+      return -1;
+    }
+    total += count;
+  }
+}
+
+long long PostgreSQLLargeObject::writeFrom(std::istream &input,
+                                           std::span<std::byte> buffer) {
+  if (!checkBuffer(buffer)) {
+    return -1;
+  }
+  long long total = 0;
+  while (input) {
+    input.read(reinterpret_cast<char *>(buffer.data()),
+               static_cast<std::streamsize>(buffer.size()));
+    std::streamsize count = input.gcount();
+    if (count <= 0) {
+      break;
+    }
+    if (write(buffer.first(static_cast<size_t>(count))) < 0) {
+      return -1;
+    }
+    total += count;
+  }
+  return input.bad() ? -1 : total;
+}
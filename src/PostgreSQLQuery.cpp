@@ -1,120 +1,191 @@
 #include "../include/PostgreSQLQuery.h"
+#include "../include/PostgreSQLTrace.h"
+#include <cstdlib>
 #include <iostream>
 #include <stdexcept>
 
 PostgreSQLQuery::PostgreSQLQuery(PostgreSQLConnection &conn)
-    : connection(conn) {
+    : connection(conn), slowQueryLog(nullptr), statementTimeout(0),
+      timedOut(false), connectionReset(false) {
   if (!isConnectionOK()) {
     throw std::runtime_error("Database connection is not established");
   }
 }
 
-PGresult *PostgreSQLQuery::execute(const std::string &query) {
+PGresult *PostgreSQLQuery::dispatch(const char *query, int paramCount,
+                                    const char *const *paramValues,
+                                    Protocol protocol, int resultFormat,
+                                    std::chrono::milliseconds timeout) {
+  timedOut = false;
+  connectionReset = false;
   if (!isConnectionOK()) {
     std::cerr << "Database connection is not OK" << std::endl;
     return nullptr;
   }
-  if (query.empty()) {
+  if (!query || !*query) {
     std::cerr << "Query cannot be empty" << std::endl;
     return nullptr;
   }
+  bool prepared = protocol == Protocol::Prepared;
+  PQXX_TRACE_SPAN_DETAIL(prepared ? "query.executePrepared" : "query.execute",
+                         "query", query);
   PGconn *rawConn = connection.getRawConnection();
-  PGresult *result = PQexec(rawConn, query.c_str());
+  auto started = std::chrono::steady_clock::now();
+  PGresult *result = nullptr;
+  if (timeout.count() <= 0) {
+    switch (protocol) {
+    case Protocol::Simple:
+      result = PQexec(rawConn, query);
+      break;
+    case Protocol::Extended:
+      result = PQexecParams(rawConn, query, paramCount,
+                            nullptr, // let server infer param types
+                            paramValues,
+                            nullptr, // param lengths (text)
+                            nullptr, // param formats (text)
+                            resultFormat);
+      break;
+    case Protocol::Prepared:
+      result = PQexecPrepared(rawConn, query, paramCount, paramValues, nullptr,
+                              nullptr, resultFormat);
+      break;
+    default:
+      std::cerr << "Unknown query protocol" << std::endl;
+      return nullptr;
+    }
+  } else {
+    int sent = 0;
+    {
+      PQXX_TRACE_SPAN("query.send", "query");
+      switch (protocol) {
+      case Protocol::Simple:
+        sent = PQsendQuery(rawConn, query);
+        break;
+      case Protocol::Extended:
+        sent = PQsendQueryParams(rawConn, query, paramCount, nullptr,
+                                 paramValues, nullptr, nullptr, resultFormat);
+        break;
+      case Protocol::Prepared:
+        sent = PQsendQueryPrepared(rawConn, query, paramCount, paramValues,
+                                   nullptr, nullptr, resultFormat);
+        break;
+      default:
+        std::cerr << "Unknown query protocol" << std::endl;
+        return nullptr;
+      }
+    }
+    if (!sent) {
+      std::cerr << "Failed to send query: " << connection.getLastError()
+                << std::endl;
+      return nullptr;
+    }
+    result = awaitResult(started + timeout);
+  }
+  recordIfSlow(query, prepared, paramCount, paramValues, started, result);
+  const char *kind = prepared         ? "Prepared statement"
+                     : paramCount > 0 ? "Parameterized query"
+                                      : "Query";
+  if (timedOut) {
+    std::cerr << kind << " cancelled after " << timeout.count()
+              << " ms timeout: " << query << std::endl;
+    return nullptr;
+  }
+  if (!result) {
+    return nullptr;
+  }
   ExecStatusType status = PQresultStatus(result);
   if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
-    std::cerr << "Query failed (" << PQresStatus(status)
+    std::cerr << kind << " failed (" << PQresStatus(status)
               << "): " << connection.getLastError() << std::endl;
     std::cerr << "Failed query: " << query << std::endl;
+    if (paramCount > 0) {
+      std::cerr << "Parameters count: " << paramCount << std::endl;
+    }
     PQclear(result);
     return nullptr;
   }
   return result;
 }
 
+PGresult *PostgreSQLQuery::execute(const std::string &query) {
+  return dispatch(query.c_str(), 0, nullptr, Protocol::Simple, 0,
+                  statementTimeout);
+}
+
+PGresult *PostgreSQLQuery::execute(const char *query) {
+  return dispatch(query, 0, nullptr, Protocol::Simple, 0,
+                  statementTimeout);
+}
+
+PGresult *PostgreSQLQuery::execute(std::string_view query) {
+  NullTerminatedText text(query);
+  return dispatch(text.c_str(), 0, nullptr, Protocol::Simple, 0,
+                  statementTimeout);
+}
+
+PGresult *PostgreSQLQuery::execute(const std::string &query,
+                                   std::chrono::milliseconds timeout) {
+  return dispatch(query.c_str(), 0, nullptr, Protocol::Simple, 0, timeout);
+}
+
 PGresult *
 PostgreSQLQuery::executeParams(const std::string &query,
                                const std::vector<std::string> &params) {
-  if (!isConnectionOK()) {
-    std::cerr << "Database connection is not OK" << std::endl;
-    return nullptr;
-  }
-  if (query.empty()) {
-    std::cerr << "Query cannot be empty" << std::endl;
-    return nullptr;
-  }
-  std::vector<const char *> paramValues;
-  for (const auto &param : params) {
-    paramValues.push_back(param.c_str());
-  }
-  PGconn *rawConn = connection.getRawConnection();
-  PGresult *result =
-      PQexecParams(rawConn, query.c_str(), params.size(),
-                   nullptr, // let server infer param types
-                   paramValues.empty() ? nullptr : paramValues.data(),
-                   nullptr, // param lengths (text means null)
-                   nullptr, // param formats (text)
-                   0);      // result format (0=text, 1=binary)
-
-  ExecStatusType status = PQresultStatus(result);
-  if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
-    std::cerr << "Parameterized query failed (" << PQresStatus(status)
-              << "): " << connection.getLastError() << std::endl;
-    std::cerr << "Failed query: " << query << std::endl;
-    std::cerr << "Parameters count: " << params.size() << std::endl;
-    PQclear(result);
-    return nullptr;
-  }
+  ParamArray paramValues(params);
+  return dispatch(query.c_str(), paramValues.size(), paramValues.data(),
+                  Protocol::Extended, 0, statementTimeout);
+}
 
-  return result;
+PGresult *
+PostgreSQLQuery::executeParams(const std::string &query,
+                               const std::vector<std::string> &params,
+                               std::chrono::milliseconds timeout) {
+  ParamArray paramValues(params);
+  return dispatch(query.c_str(), paramValues.size(), paramValues.data(),
+                  Protocol::Extended, 0, timeout);
 }
 
 PGresult *
 PostgreSQLQuery::executeParams(const std::string &query,
                                const std::vector<const char *> &params) {
-  if (!isConnectionOK()) {
-    std::cerr << "Database connection is not OK" << std::endl;
-    return nullptr;
-  }
-  PGconn *rawConn = connection.getRawConnection();
-  PGresult *result = PQexecParams(
-      rawConn, query.c_str(), params.size(), nullptr,
-      params.empty() ? nullptr : params.data(), nullptr, nullptr, 0);
-  ExecStatusType status = PQresultStatus(result);
-  if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
-    std::cerr << "Parameterized query failed (" << PQresStatus(status)
-              << "): " << connection.getLastError() << std::endl;
-    PQclear(result);
-    return nullptr;
-  }
+  return dispatch(query.c_str(), static_cast<int>(params.size()),
+                  params.empty() ? nullptr : params.data(),
+                  Protocol::Extended, 0, statementTimeout);
+}
 
-  return result;
+PGresult *
+PostgreSQLQuery::executeParams(std::string_view query,
+                               std::span<const std::string_view> params) {
+  NullTerminatedText text(query);
+  ParamArray paramValues(params);
+  return dispatch(text.c_str(), paramValues.size(), paramValues.data(),
+                  Protocol::Extended, 0, statementTimeout);
+}
+
+PGresult *PostgreSQLQuery::executeParams(
+    std::string_view query,
+    std::span<const std::optional<std::string_view>> params) {
+  NullTerminatedText text(query);
+  ParamArray paramValues(params);
+  return dispatch(text.c_str(), paramValues.size(), paramValues.data(),
+                  Protocol::Extended, 0, statementTimeout);
+}
+
+PGresult *
+PostgreSQLQuery::executeParamsBinary(const std::string &query,
+                                     const std::vector<std::string> &params) {
+  ParamArray paramValues(params);
+  return dispatch(query.c_str(), paramValues.size(), paramValues.data(),
+                  Protocol::Extended, 1, // binary results
+                  statementTimeout);
 }
 
 PGresult *
 PostgreSQLQuery::executePrepared(const std::string &stmtName,
                                  const std::vector<std::string> &params) {
-  if (!isConnectionOK()) {
-    std::cerr << "Database connection is not OK" << std::endl;
-    return nullptr;
-  }
-  std::vector<const char *> paramValues;
-  for (const auto &param : params) {
-    paramValues.push_back(param.c_str());
-  }
-  PGconn *rawConn = connection.getRawConnection();
-  PGresult *result = PQexecPrepared(
-      rawConn, stmtName.c_str(), params.size(),
-      paramValues.empty() ? nullptr : paramValues.data(), nullptr, nullptr, 0);
-
-  ExecStatusType status = PQresultStatus(result);
-  if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
-    std::cerr << "Prepared statement failed (" << PQresStatus(status)
-              << "): " << connection.getLastError() << std::endl;
-    PQclear(result);
-    return nullptr;
-  }
-
-  return result;
+  ParamArray paramValues(params);
+  return dispatch(stmtName.c_str(), paramValues.size(), paramValues.data(),
+                  Protocol::Prepared, 0, statementTimeout);
 }
 
 bool PostgreSQLQuery::executeCommand(const std::string &query) {
@@ -169,3 +240,97 @@ bool PostgreSQLQuery::isConnectionOK() const { return connection.isOK(); }
 std::string PostgreSQLQuery::getLastError() const {
   return connection.getLastError();
 }
+
+void PostgreSQLQuery::setSlowQueryLog(PostgreSQLSlowQueryLog *log) {
+  slowQueryLog = log;
+}
+
+void PostgreSQLQuery::recordIfSlow(
+    const char *query, bool prepared, int paramCount,
+    const char *const *paramValues,
+    std::chrono::steady_clock::time_point started, PGresult *result) {
+  if (!slowQueryLog) {
+    return;
+  }
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - started);
+  if (!slowQueryLog->isSlow(duration)) {
+    return;
+  }
+  long long rows = -1;
+  ExecStatusType status = PQresultStatus(result);
+  if (status == PGRES_TUPLES_OK) {
+    rows = PQntuples(result);
+  } else if (status == PGRES_COMMAND_OK) {
+    const char *affected = PQcmdTuples(result);
+    rows = affected && *affected ? std::atoll(affected) : 0;
+  }
+  // Parameters are only copied once the statement is known to be slow.
+  std::vector<std::optional<std::string>> params;
+  for (int i = 0; i < paramCount; ++i) {
+    if (paramValues[i]) {
+      params.emplace_back(paramValues[i]);
+    } else {
+      params.emplace_back(std::nullopt);
+    }
+  }
+  // A prepared statement only exists on this session, so it is logged by
+  // name and cannot be explained on the log's side connection.
+  std::string label = prepared ? std::string("EXECUTE ") + query : query;
+  slowQueryLog->record(label, params, duration, rows, !prepared);
+}
+
+void PostgreSQLQuery::setStatementTimeout(std::chrono::milliseconds timeout) {
+  statementTimeout = timeout;
+}
+
+bool PostgreSQLQuery::lastCallTimedOut() const { return timedOut; }
+
+bool PostgreSQLQuery::lastCallResetConnection() const {
+  return connectionReset;
+}
+
+bool PostgreSQLQuery::cancel() { return connection.cancel(); }
+
+PGresult *
+PostgreSQLQuery::awaitResult(std::chrono::steady_clock::time_point deadline) {
+  PGconn *rawConn = connection.getRawConnection();
+  PGresult *last = nullptr;
+  timedOut = false;
+  while (true) {
+    bool ready;
+    {
+      PQXX_TRACE_SPAN("query.wait", "query");
+      ready = connection.waitForResult(deadline);
+    }
+    if (!ready) {
+      PQclear(last);
+      if (std::chrono::steady_clock::now() >= deadline) {
+        timedOut = true;
+        connection.cancel();
+        connectionReset = connection.discardResults() == DrainResult::Reset;
+      }
+      return nullptr;
+    }
+    PGresult *next;
+    {
+      PQXX_TRACE_SPAN("query.receive", "query");
+      next = PQgetResult(rawConn);
+    }
+    if (!next) {
+      return last;
+    }
+    PQclear(last);
+    ExecStatusType status = PQresultStatus(next);
+    if (status == PGRES_COPY_IN || status == PGRES_COPY_OUT ||
+        status == PGRES_COPY_BOTH) {
+      // PQgetResult would return the COPY result forever; the copy data is
+      // not handled here, so leave COPY mode and report the statement.
+      PQclear(next);
+      std::cerr << "COPY is not supported by PostgreSQLQuery" << std::endl;
+      connectionReset = connection.discardResults() == DrainResult::Reset;
+      return nullptr;
+    }
+    last = next;
+  }
+}
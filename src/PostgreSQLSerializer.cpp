@@ -0,0 +1,518 @@
+#include "../include/PostgreSQLSerializer.h"
+#include "../include/PostgreSQLTrace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <unistd.h>
+
+namespace {
+
+constexpr Oid BoolOid = 16;
+constexpr Oid Int8Oid = 20;
+constexpr Oid Int2Oid = 21;
+constexpr Oid Int4Oid = 23;
+constexpr Oid OidOid = 26;
+constexpr Oid Float4Oid = 700;
+constexpr Oid Float8Oid = 701;
+constexpr Oid NumericOid = 1700;
+
+// NaN and the infinities have no JSON number form.
+bool isJsonNumber(const char *value, size_t length) {
+  size_t start = length > 0 && value[0] == '-' ? 1 : 0;
+  return start < length && value[start] >= '0' && value[start] <= '9';
+}
+
+} // namespace
+
+OutputBuffer::OutputBuffer(int fd, size_t capacity)
+    : buffer(new char[capacity ? capacity : 1]),
+      capacity(capacity ? capacity : 1), used(0), fd(fd), stream(nullptr),
+      failed(false) {}
+
+OutputBuffer::OutputBuffer(std::ostream &stream, size_t capacity)
+    : buffer(new char[capacity ? capacity : 1]),
+      capacity(capacity ? capacity : 1), used(0), fd(-1), stream(&stream),
+      failed(false) {}
+
+OutputBuffer::OutputBuffer(std::function<bool(const char *, size_t)> sink,
+                           size_t capacity)
+    : buffer(new char[capacity ? capacity : 1]),
+      capacity(capacity ? capacity : 1), used(0), fd(-1), stream(nullptr),
+      sink(std::move(sink)), failed(false) {}
+
+OutputBuffer::~OutputBuffer() { flush(); }
+
+void OutputBuffer::drain(const char *data, size_t size) {
+  if (failed) {
+    return;
+  }
+  if (stream) {
+    stream->write(data, static_cast<std::streamsize>(size));
+    failed = !*stream;
+    return;
+  }
+  if (sink) {
+    failed = !sink(data, size);
+    return;
+  }
+  while (size > 0) {
+    ssize_t written = ::write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      failed = true;
+      return;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+}
+
+void OutputBuffer::append(const char *data, size_t size) {
+  if (size > capacity - used) {
+    flush();
+    if (size >= capacity) {
+      drain(data, size);
+      return;
+    }
+  }
+  std::memcpy(buffer.get() + used, data, size);
+  used += size;
+}
+
+void OutputBuffer::appendRepeated(char c, size_t count) {
+  while (count > 0) {
+    if (used == capacity) {
+      flush();
+    }
+    size_t chunk = std::min(count, capacity - used);
+    std::memset(buffer.get() + used, c, chunk);
+    used += chunk;
+    count -= chunk;
+  }
+}
+
+void OutputBuffer::appendNumber(size_t value) {
+  char digits[24];
+  size_t pos = sizeof(digits);
+  do {
+    digits[--pos] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value > 0);
+  append(digits + pos, sizeof(digits) - pos);
+}
+
+bool OutputBuffer::flush() {
+  if (used > 0) {
+    drain(buffer.get(), used);
+    used = 0;
+  }
+  return !failed;
+}
+
+bool OutputBuffer::hasError() const { return failed; }
+
+void PostgreSQLSerializer::appendCsvEscaped(OutputBuffer &output,
+                                            const char *value,
+                                            size_t length) {
+  // Empty strings are quoted so they stay distinguishable from NULL.
+  bool needsQuotes = length == 0;
+  for (size_t i = 0; i < length && !needsQuotes; ++i) {
+    char c = value[i];
+    needsQuotes = c == ',' || c == '"' || c == '\n' || c == '\r';
+  }
+  if (!needsQuotes) {
+    output.append(value, length);
+    return;
+  }
+  output.append('"');
+  size_t start = 0;
+  for (size_t i = 0; i < length; ++i) {
+    if (value[i] == '"') {
+      output.append(value + start, i - start + 1);
+      output.append('"');
+      start = i + 1;
+    }
+  }
+  output.append(value + start, length - start);
+  output.append('"');
+}
+
+void PostgreSQLSerializer::appendTsvEscaped(OutputBuffer &output,
+                                            const char *value,
+                                            size_t length) {
+  size_t start = 0;
+  for (size_t i = 0; i < length; ++i) {
+    char escaped;
+    switch (value[i]) {
+    case '\\':
+      escaped = '\\';
+      break;
+    case '\t':
+      escaped = 't';
+      break;
+    case '\n':
+      escaped = 'n';
+      break;
+    case '\r':
+      escaped = 'r';
+      break;
+    default:
+      continue;
+    }
+    output.append(value + start, i - start);
+    output.append('\\');
+    output.append(escaped);
+    start = i + 1;
+  }
+  output.append(value + start, length - start);
+}
+
+void PostgreSQLSerializer::appendJsonEscaped(OutputBuffer &output,
+                                             const char *value,
+                                             size_t length) {
+  static const char hex[] = "0123456789abcdef";
+  output.append('"');
+  size_t start = 0;
+  for (size_t i = 0; i < length; ++i) {
+    unsigned char c = static_cast<unsigned char>(value[i]);
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    output.append(value + start, i - start);
+    start = i + 1;
+    switch (c) {
+    case '"':
+      output.append("\\\"", 2);
+      break;
+    case '\\':
+      output.append("\\\\", 2);
+      break;
+    case '\n':
+      output.append("\\n", 2);
+      break;
+    case '\r':
+      output.append("\\r", 2);
+      break;
+    case '\t':
+      output.append("\\t", 2);
+      break;
+    default: {
+      char unicode[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+      output.append(unicode, sizeof(unicode));
+    }
+    }
+  }
+  output.append(value + start, length - start);
+  output.append('"');
+}
+
+RowSerializer::RowSerializer(OutputBuffer &out, SerializationFormat fmt)
+    : output(out), format(fmt), rowCount(0) {
+  if (format == SerializationFormat::Table) {
+    throw std::invalid_argument(
+        "Table format needs the whole result; use writeTable");
+  }
+}
+
+void RowSerializer::writeHeader(const std::vector<std::string> &columns,
+                                bool emitHeaderLine) {
+  if (format == SerializationFormat::JSONLines) {
+    // Keys are escaped once and reused for every row.
+    jsonKeys.clear();
+    for (const auto &column : columns) {
+      std::ostringstream keyStream;
+      {
+        OutputBuffer keyBuffer(keyStream, column.size() * 6 + 3);
+        PostgreSQLSerializer::appendJsonEscaped(keyBuffer, column.data(),
+                                                column.size());
+        keyBuffer.append(':');
+      }
+      std::string key = keyStream.str();
+      jsonKeys.push_back(std::move(key));
+    }
+    return;
+  }
+  if (!emitHeaderLine) {
+    return;
+  }
+  for (size_t i = 0; i < columns.size(); ++i) {
+    if (i > 0) {
+      output.append(format == SerializationFormat::CSV ? ',' : '\t');
+    }
+    writeField(columns[i].data(), columns[i].size(), i);
+  }
+  output.append('\n');
+}
+
+void RowSerializer::setColumnTypes(const std::vector<Oid> &types) {
+  jsonKinds.clear();
+  for (Oid type : types) {
+    switch (type) {
+    case BoolOid:
+      jsonKinds.push_back(JsonKind::Bool);
+      break;
+    case Int2Oid:
+    case Int4Oid:
+    case Int8Oid:
+    case OidOid:
+    case Float4Oid:
+    case Float8Oid:
+    case NumericOid:
+      jsonKinds.push_back(JsonKind::Number);
+      break;
+    default:
+      jsonKinds.push_back(JsonKind::String);
+    }
+  }
+}
+
+void RowSerializer::writeField(const char *value, size_t length,
+                               size_t column) {
+  switch (format) {
+  case SerializationFormat::CSV:
+    if (value) {
+      PostgreSQLSerializer::appendCsvEscaped(output, value, length);
+    }
+    break;
+  case SerializationFormat::TSV:
+    if (value) {
+      PostgreSQLSerializer::appendTsvEscaped(output, value, length);
+    } else {
+      output.append("\\N", 2);
+    }
+    break;
+  case SerializationFormat::JSONLines:
+    if (column < jsonKeys.size()) {
+      output.append(jsonKeys[column]);
+    } else {
+      output.append('"');
+      output.appendNumber(column);
+      output.append("\":", 2);
+    }
+    if (!value) {
+      output.append("null", 4);
+      break;
+    }
+    switch (column < jsonKinds.size() ? jsonKinds[column] : JsonKind::String) {
+    case JsonKind::Bool:
+      if (length == 1 && (*value == 't' || *value == 'f')) {
+        output.append(*value == 't' ? "true" : "false");
+        return;
+      }
+      break;
+    case JsonKind::Number:
+      if (isJsonNumber(value, length)) {
+        output.append(value, length);
+        return;
+      }
+      break;
+    case JsonKind::String:
+      break;
+    }
+    PostgreSQLSerializer::appendJsonEscaped(output, value, length);
+    break;
+  case SerializationFormat::Table:
+    break;
+  }
+}
+
+void RowSerializer::writeRow(const char *const *values, const int *lengths,
+                             size_t count) {
+  bool json = format == SerializationFormat::JSONLines;
+  char separator = format == SerializationFormat::TSV ? '\t' : ',';
+  if (json) {
+    output.append('{');
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (i > 0) {
+      output.append(separator);
+    }
+    const char *value = values[i];
+    size_t length = 0;
+    if (value) {
+      length = lengths ? static_cast<size_t>(lengths[i]) : std::strlen(value);
+    }
+    writeField(value, length, i);
+  }
+  output.append(json ? "}\n" : "\n", json ? 2 : 1);
+  ++rowCount;
+}
+
+void RowSerializer::writeRow(const std::vector<std::string> &values) {
+  bool json = format == SerializationFormat::JSONLines;
+  char separator = format == SerializationFormat::TSV ? '\t' : ',';
+  if (json) {
+    output.append('{');
+  }
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (i > 0) {
+      output.append(separator);
+    }
+    writeField(values[i].data(), values[i].size(), i);
+  }
+  output.append(json ? "}\n" : "\n", json ? 2 : 1);
+  ++rowCount;
+}
+
+size_t RowSerializer::getRowCount() const { return rowCount; }
+
+bool PostgreSQLSerializer::write(PGresult *result, SerializationFormat format,
+                                 OutputBuffer &output, bool header) {
+  PQXX_TRACE_SPAN("result.serialize", "result");
+  if (!PostgreSQLUtils::isResultValid(result)) {
+    return false;
+  }
+  if (format == SerializationFormat::Table) {
+    writeTable(result, output);
+    return output.flush();
+  }
+  int rowCount = PQntuples(result);
+  int colCount = PQnfields(result);
+  RowSerializer serializer(output, format);
+  serializer.writeHeader(PostgreSQLUtils::getColumnNames(result), header);
+  std::vector<Oid> types(colCount);
+  for (int col = 0; col < colCount; ++col) {
+    // Binary values are not text; leave them typed as strings.
+    types[col] = PQfformat(result, col) == 0 ? PQftype(result, col) : 0;
+  }
+  serializer.setColumnTypes(types);
+  std::vector<const char *> values(colCount);
+  std::vector<int> lengths(colCount);
+  for (int row = 0; row < rowCount; ++row) {
+    for (int col = 0; col < colCount; ++col) {
+      values[col] =
+          PQgetisnull(result, row, col) ? nullptr : PQgetvalue(result, row, col);
+      lengths[col] = PQgetlength(result, row, col);
+    }
+    serializer.writeRow(values.data(), lengths.data(), colCount);
+  }
+  return output.flush();
+}
+
+bool PostgreSQLSerializer::write(const QueryResult &result,
+                                 SerializationFormat format,
+                                 OutputBuffer &output, bool header) {
+  PQXX_TRACE_SPAN("result.serialize", "result");
+  if (result.hasError()) {
+    return false;
+  }
+  if (format == SerializationFormat::Table) {
+    writeTable(result, output);
+    return output.flush();
+  }
+  RowSerializer serializer(output, format);
+  serializer.writeHeader(result.getColumnNames(), header);
+  serializer.setColumnTypes(result.getColumnTypes());
+  // QueryResult keeps SQL NULL as an empty value; isNull() is its test.
+  std::vector<const char *> values;
+  std::vector<int> lengths;
+  result.forEachRow([&](const ResultRow &row) {
+    const auto &rowValues = row.getValues();
+    values.resize(rowValues.size());
+    lengths.resize(rowValues.size());
+    for (size_t i = 0; i < rowValues.size(); ++i) {
+      bool null = row.isNull(static_cast<int>(i));
+      values[i] = null ? nullptr : rowValues[i].data();
+      lengths[i] = static_cast<int>(rowValues[i].size());
+    }
+    serializer.writeRow(values.data(), lengths.data(), values.size());
+    return true;
+  });
+  return output.flush();
+}
+
+bool PostgreSQLSerializer::write(PGresult *result, SerializationFormat format,
+                                 int fd, bool header) {
+  OutputBuffer output(fd);
+  return write(result, format, output, header);
+}
+
+bool PostgreSQLSerializer::write(PGresult *result, SerializationFormat format,
+                                 std::ostream &output, bool header) {
+  OutputBuffer buffer(output);
+  return write(result, format, buffer, header);
+}
+
+static void writeTableHeader(OutputBuffer &output,
+                             const std::vector<std::string> &columnNames,
+                             const std::vector<size_t> &columnWidths) {
+  for (size_t i = 0; i < columnNames.size(); ++i) {
+    output.append(columnNames[i]);
+    output.appendRepeated(' ', columnWidths[i] + 2 - columnNames[i].size());
+  }
+  output.append('\n');
+  for (size_t i = 0; i < columnNames.size(); ++i) {
+    output.appendRepeated('-', columnWidths[i] + 2);
+  }
+  output.append('\n');
+}
+
+void PostgreSQLSerializer::writeTable(PGresult *result, OutputBuffer &output) {
+  std::vector<std::string> columnNames =
+      PostgreSQLUtils::getColumnNames(result);
+  if (columnNames.empty()) {
+    output.append("No columns\n");
+    return;
+  }
+  int rowCount = PQntuples(result);
+  int colCount = static_cast<int>(columnNames.size());
+  std::vector<size_t> columnWidths;
+  for (const auto &colName : columnNames) {
+    columnWidths.push_back(colName.length());
+  }
+  for (int row = 0; row < rowCount; ++row) {
+    for (int col = 0; col < colCount; ++col) {
+      columnWidths[col] = std::max(
+          columnWidths[col], static_cast<size_t>(PQgetlength(result, row, col)));
+    }
+  }
+  writeTableHeader(output, columnNames, columnWidths);
+  for (int row = 0; row < rowCount; ++row) {
+    for (int col = 0; col < colCount; ++col) {
+      size_t length = static_cast<size_t>(PQgetlength(result, row, col));
+      output.append(PQgetvalue(result, row, col), length);
+      output.appendRepeated(' ', columnWidths[col] + 2 - length);
+    }
+    output.append('\n');
+  }
+  output.append("Total rows: ");
+  output.appendNumber(static_cast<size_t>(rowCount));
+  output.append('\n');
+}
+
+void PostgreSQLSerializer::writeTable(const QueryResult &result,
+                                      OutputBuffer &output) {
+  const auto &columnNames = result.getColumnNames();
+  size_t rowCount = result.getRowCount();
+  if (columnNames.empty()) {
+    output.append("No columns\n");
+    return;
+  }
+  std::vector<size_t> columnWidths;
+  for (const auto &colName : columnNames) {
+    columnWidths.push_back(colName.length());
+  }
+  for (size_t row = 0; row < rowCount; ++row) {
+    const auto &values = result.getRow(row).getValues();
+    for (size_t i = 0; i < values.size() && i < columnWidths.size(); ++i) {
+      columnWidths[i] = std::max(columnWidths[i], values[i].length());
+    }
+  }
+  writeTableHeader(output, columnNames, columnWidths);
+  for (size_t row = 0; row < rowCount; ++row) {
+    const auto &values = result.getRow(row).getValues();
+    for (size_t i = 0; i < values.size() && i < columnWidths.size(); ++i) {
+      output.append(values[i]);
+      output.appendRepeated(' ', columnWidths[i] + 2 - values[i].length());
+    }
+    output.append('\n');
+  }
+  output.append("Total rows: ");
+  output.appendNumber(rowCount);
+  output.append('\n');
+}
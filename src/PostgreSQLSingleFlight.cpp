@@ -0,0 +1,112 @@
+#include "../include/PostgreSQLSingleFlight.h"
+#include <string_view>
+
+PostgreSQLSingleFlight::PostgreSQLSingleFlight()
+    : executedCount(0), sharedCount(0) {}
+
+static void appendKeyPart(std::string &key, std::string_view part) {
+  key += std::to_string(part.size());
+  key += ':';
+  key += part;
+}
+
+std::string
+PostgreSQLSingleFlight::makeKey(PostgreSQLConnection &connection,
+                                const std::string &query,
+                                const std::vector<std::string> &params,
+                                size_t memoryBudget) {
+  // Identical SQL against another database or as another role is a
+  // different read. Every part is length-prefixed so that no two distinct
+  // combinations can produce the same key.
+  PGconn *conn = connection.getRawConnection();
+  auto text = [](const char *value) { return value ? value : ""; };
+  size_t size = query.size() + 128;
+  for (const auto &param : params) {
+    size += param.size() + 16;
+  }
+  std::string key;
+  key.reserve(size);
+  appendKeyPart(key, text(PQhost(conn)));
+  appendKeyPart(key, text(PQport(conn)));
+  appendKeyPart(key, text(PQdb(conn)));
+  appendKeyPart(key, text(PQuser(conn)));
+  appendKeyPart(key, std::to_string(memoryBudget));
+  appendKeyPart(key, query);
+  for (const auto &param : params) {
+    appendKeyPart(key, param);
+  }
+  return key;
+}
+
+PostgreSQLSingleFlight::SharedResult
+PostgreSQLSingleFlight::run(const std::string &key,
+                            const std::function<QueryResult()> &execute) {
+  std::promise<SharedResult> promise;
+  std::unique_lock<std::mutex> lock(mutex);
+  auto it = inFlight.find(key);
+  if (it != inFlight.end()) {
+    std::shared_future<SharedResult> pending = it->second;
+    lock.unlock();
+    SharedResult shared = pending.get();
+    // Reading a spilled result decodes rows into a per-result cache, so a
+    // spilled result is never handed to more than one caller.
+    if (!shared->isSpilled()) {
+      sharedCount.fetch_add(1, std::memory_order_relaxed);
+      return shared;
+    }
+    executedCount.fetch_add(1, std::memory_order_relaxed);
+    return std::make_shared<const QueryResult>(execute());
+  }
+  inFlight.emplace(key, promise.get_future().share());
+  lock.unlock();
+  executedCount.fetch_add(1, std::memory_order_relaxed);
+
+  SharedResult result;
+  try {
+    result = std::make_shared<const QueryResult>(execute());
+  } catch (...) {
+    lock.lock();
+    inFlight.erase(key);
+    lock.unlock();
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+  // Unregister before publishing: callers arriving from now on start a
+  // fresh execution instead of receiving this (possibly stale) result.
+  lock.lock();
+  inFlight.erase(key);
+  lock.unlock();
+  promise.set_value(result);
+  return result;
+}
+
+PostgreSQLSingleFlight::SharedResult
+PostgreSQLSingleFlight::executeQuery(PostgreSQLConnection &connection,
+                                     const std::string &query,
+                                     size_t memoryBudget) {
+  return run(makeKey(connection, query, {}, memoryBudget), [&] {
+    return PostgreSQLUtils::executeQuery(connection, query, memoryBudget);
+  });
+}
+
+PostgreSQLSingleFlight::SharedResult PostgreSQLSingleFlight::executeQueryParams(
+    PostgreSQLConnection &connection, const std::string &query,
+    const std::vector<std::string> &params, size_t memoryBudget) {
+  return run(makeKey(connection, query, params, memoryBudget), [&] {
+    return PostgreSQLUtils::executeQueryParams(connection, query, params,
+                                               memoryBudget);
+  });
+}
+
+size_t PostgreSQLSingleFlight::getInFlightCount() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return inFlight.size();
+}
+
+size_t PostgreSQLSingleFlight::getExecutedCount() const {
+  return executedCount.load(std::memory_order_relaxed);
+}
+
+size_t PostgreSQLSingleFlight::getSharedCount() const {
+  return sharedCount.load(std::memory_order_relaxed);
+}
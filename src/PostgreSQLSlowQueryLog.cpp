@@ -0,0 +1,187 @@
+#include "../include/PostgreSQLSlowQueryLog.h"
+#include <ctime>
+#include <iomanip>
+
+PostgreSQLSlowQueryLog::PostgreSQLSlowQueryLog(const SlowQueryLogConfig &cfg)
+    : config(cfg), explainConnection(nullptr), nextSlot(0), totalRecorded(0),
+      lastExplain(), stopping(false) {
+  if (config.capacity == 0) {
+    config.capacity = 1;
+  }
+  entries.reserve(config.capacity);
+  entrySequence.reserve(config.capacity);
+  if (config.explainSampleRate > 0) {
+    explainWorker = std::thread(&PostgreSQLSlowQueryLog::explainLoop, this);
+  }
+}
+
+PostgreSQLSlowQueryLog::~PostgreSQLSlowQueryLog() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  explainReady.notify_all();
+  if (explainWorker.joinable()) {
+    explainWorker.join();
+  }
+}
+
+void PostgreSQLSlowQueryLog::setExplainConnection(PostgreSQLConnection *conn) {
+  std::lock_guard<std::mutex> explainLock(explainMutex);
+  explainConnection = conn;
+}
+
+std::chrono::microseconds PostgreSQLSlowQueryLog::getThreshold() const {
+  return config.threshold;
+}
+
+bool PostgreSQLSlowQueryLog::isSlow(std::chrono::microseconds duration) const {
+  return duration >= config.threshold;
+}
+
+void PostgreSQLSlowQueryLog::record(
+    const std::string &query,
+    const std::vector<std::optional<std::string>> &params,
+    std::chrono::microseconds duration, long long rows, bool explainable) {
+  if (!isSlow(duration)) {
+    return;
+  }
+  SlowQueryEntry entry;
+  entry.timestamp = std::chrono::system_clock::now();
+  entry.query = query;
+  entry.duration = duration;
+  entry.rows = rows;
+  for (const auto &param : params) {
+    if (param && config.redactParams) {
+      entry.params.push_back("<redacted " + std::to_string(param->size()) +
+                             " bytes>");
+    } else {
+      entry.params.push_back(param);
+    }
+  }
+
+  bool runExplain = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++totalRecorded;
+    auto now = std::chrono::steady_clock::now();
+    // Only one EXPLAIN is kept pending; the caller never waits for it.
+    if (explainable && explainWorker.joinable() && explainQueue.empty() &&
+        totalRecorded % config.explainSampleRate == 0 &&
+        (lastExplain == std::chrono::steady_clock::time_point() ||
+         now - lastExplain >= config.explainMinInterval)) {
+      lastExplain = now;
+      runExplain = true;
+      explainQueue.push_back(ExplainJob{totalRecorded, query, params});
+    }
+    if (entries.size() < config.capacity) {
+      entries.push_back(std::move(entry));
+      entrySequence.push_back(totalRecorded);
+    } else {
+      entries[nextSlot] = std::move(entry);
+      entrySequence[nextSlot] = totalRecorded;
+    }
+    nextSlot = (nextSlot + 1) % config.capacity;
+  }
+  if (runExplain) {
+    explainReady.notify_one();
+  }
+}
+
+void PostgreSQLSlowQueryLog::explainLoop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    explainReady.wait(lock,
+                      [this] { return stopping || !explainQueue.empty(); });
+    if (stopping) {
+      return;
+    }
+    ExplainJob job = std::move(explainQueue.front());
+    explainQueue.pop_front();
+    lock.unlock();
+    std::string plan = explain(job.query, job.params);
+    lock.lock();
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (entrySequence[i] == job.sequence) {
+        entries[i].explainPlan = std::move(plan);
+        break;
+      }
+    }
+  }
+}
+
+std::string PostgreSQLSlowQueryLog::explain(
+    const std::string &query,
+    const std::vector<std::optional<std::string>> &params) {
+  std::lock_guard<std::mutex> explainLock(explainMutex);
+  if (!explainConnection || !explainConnection->isOK()) {
+    return "";
+  }
+  // Plain EXPLAIN never executes the statement, so writes are safe to plan.
+  std::string explainQuery = "EXPLAIN (FORMAT JSON) " + query;
+  std::vector<const char *> paramValues;
+  for (const auto &param : params) {
+    paramValues.push_back(param ? param->c_str() : nullptr);
+  }
+  PGresult *result = PQexecParams(
+      explainConnection->getRawConnection(), explainQuery.c_str(),
+      params.size(), nullptr,
+      paramValues.empty() ? nullptr : paramValues.data(), nullptr, nullptr, 0);
+  std::string plan;
+  if (PQresultStatus(result) == PGRES_TUPLES_OK && PQntuples(result) > 0) {
+    plan = PQgetvalue(result, 0, 0);
+  } else {
+    plan = "EXPLAIN failed: " + explainConnection->getLastError();
+  }
+  PQclear(result);
+  return plan;
+}
+
+std::vector<SlowQueryEntry> PostgreSQLSlowQueryLog::getEntries() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<SlowQueryEntry> ordered;
+  ordered.reserve(entries.size());
+  size_t start = entries.size() < config.capacity ? 0 : nextSlot;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    ordered.push_back(entries[(start + i) % entries.size()]);
+  }
+  return ordered;
+}
+
+size_t PostgreSQLSlowQueryLog::getTotalRecorded() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return totalRecorded;
+}
+
+void PostgreSQLSlowQueryLog::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  entrySequence.clear();
+  nextSlot = 0;
+}
+
+void PostgreSQLSlowQueryLog::dump(std::ostream &output) const {
+  for (const auto &entry : getEntries()) {
+    std::time_t time = std::chrono::system_clock::to_time_t(entry.timestamp);
+    std::tm utc{};
+    gmtime_r(&time, &utc);
+    output << std::put_time(&utc, "%Y-%m-%dT%H:%M:%SZ")
+           << " duration=" << entry.duration.count() / 1000.0 << "ms"
+           << " rows=" << entry.rows << "\n  query: " << entry.query << "\n";
+    for (size_t i = 0; i < entry.params.size(); ++i) {
+      output << "  $" << i + 1 << " = ";
+      if (!entry.params[i]) {
+        output << "NULL";
+      } else if (config.redactParams) {
+        output << *entry.params[i];
+      } else {
+        output << "'" << *entry.params[i] << "'";
+      }
+      output << "\n";
+    }
+    if (!entry.explainPlan.empty()) {
+      output << "  plan: " << entry.explainPlan << "\n";
+    }
+  }
+  output.flush();
+}
@@ -0,0 +1,286 @@
+#include "../include/PostgreSQLTrace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unistd.h>
+
+namespace {
+
+struct ThreadBuffer {
+  std::mutex mutex;
+  std::vector<TraceSpan> spans;
+  uint32_t threadId;
+};
+
+struct TraceRegistry {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  std::atomic<uint32_t> nextThreadId{1};
+};
+
+TraceRegistry &registry() {
+  static TraceRegistry instance;
+  return instance;
+}
+
+std::atomic<bool> enabled(true);
+std::atomic<size_t> bufferCapacity(1 << 16);
+std::atomic<size_t> droppedSpans(0);
+std::atomic<uint64_t> nextSpanId(1);
+
+// Innermost open span on this thread, used as the parent of new spans.
+thread_local uint64_t currentTraceId = 0;
+thread_local uint64_t currentSpanId = 0;
+
+ThreadBuffer &localBuffer() {
+  // The registry keeps a reference so spans survive the thread that
+  // recorded them until the next collect().
+  thread_local std::shared_ptr<ThreadBuffer> buffer = [] {
+    auto created = std::make_shared<ThreadBuffer>();
+    TraceRegistry &traces = registry();
+    created->threadId = traces.nextThreadId.fetch_add(1);
+    std::lock_guard<std::mutex> lock(traces.mutex);
+    traces.buffers.push_back(created);
+    return created;
+  }();
+  return *buffer;
+}
+
+// Upper 64 bits of every OTLP trace id, so ids differ between processes.
+uint64_t processTraceSalt() {
+  static const uint64_t salt = std::random_device{}() * 0x9E3779B97F4A7C15ULL ^
+                               static_cast<uint64_t>(getpid());
+  return salt;
+}
+
+// Offset from the steady clock to Unix time, taken once.
+uint64_t unixOffsetNs() {
+  static const uint64_t offset = [] {
+    auto unixNow = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+    return static_cast<uint64_t>(unixNow) - PostgreSQLTrace::nowNs();
+  }();
+  return offset;
+}
+
+void writeJsonString(std::ostream &output, std::string_view text) {
+  output << '"';
+  for (unsigned char c : text) {
+    switch (c) {
+    case '"':
+      output << "\\\"";
+      break;
+    case '\\':
+      output << "\\\\";
+      break;
+    case '\n':
+      output << "\\n";
+      break;
+    case '\r':
+      output << "\\r";
+      break;
+    case '\t':
+      output << "\\t";
+      break;
+    default:
+      if (c < 0x20) {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        output << escaped;
+      } else {
+        output << static_cast<char>(c);
+      }
+    }
+  }
+  output << '"';
+}
+
+std::string hexId(uint64_t high, uint64_t low, bool wide) {
+  char text[33];
+  if (wide) {
+    std::snprintf(text, sizeof(text), "%016llx%016llx",
+                  static_cast<unsigned long long>(high),
+                  static_cast<unsigned long long>(low));
+  } else {
+    std::snprintf(text, sizeof(text), "%016llx",
+                  static_cast<unsigned long long>(low));
+  }
+  return text;
+}
+
+} // namespace
+
+void PostgreSQLTrace::setEnabled(bool value) { enabled.store(value); }
+
+bool PostgreSQLTrace::isEnabled() {
+  return enabled.load(std::memory_order_relaxed);
+}
+
+void PostgreSQLTrace::setThreadBufferCapacity(size_t spans) {
+  bufferCapacity.store(spans);
+}
+
+size_t PostgreSQLTrace::getDroppedCount() { return droppedSpans.load(); }
+
+uint64_t PostgreSQLTrace::nowNs() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+void PostgreSQLTrace::record(TraceSpan span) {
+  ThreadBuffer &buffer = localBuffer();
+  span.threadId = buffer.threadId;
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  if (buffer.spans.size() >= bufferCapacity.load(std::memory_order_relaxed)) {
+    droppedSpans.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  buffer.spans.push_back(std::move(span));
+}
+
+std::vector<TraceSpan> PostgreSQLTrace::collect() {
+  std::vector<TraceSpan> spans;
+  TraceRegistry &traces = registry();
+  std::lock_guard<std::mutex> lock(traces.mutex);
+  for (auto &buffer : traces.buffers) {
+    std::vector<TraceSpan> drained;
+    {
+      std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+      drained.swap(buffer->spans);
+    }
+    std::move(drained.begin(), drained.end(), std::back_inserter(spans));
+  }
+  // Buffers only the registry still references belong to exited threads.
+  std::erase_if(traces.buffers,
+                [](const auto &buffer) { return buffer.use_count() == 1; });
+  std::sort(spans.begin(), spans.end(),
+            [](const TraceSpan &a, const TraceSpan &b) {
+              return a.startNs < b.startNs;
+            });
+  return spans;
+}
+
+void PostgreSQLTrace::clear() {
+  collect();
+  droppedSpans.store(0);
+}
+
+bool PostgreSQLTrace::writeChromeTrace(std::ostream &output) {
+  std::vector<TraceSpan> spans = collect();
+  int pid = getpid();
+  output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  for (size_t i = 0; i < spans.size(); ++i) {
+    const TraceSpan &span = spans[i];
+    char timing[96];
+    std::snprintf(timing, sizeof(timing), "\"ts\":%.3f,\"dur\":%.3f",
+                  span.startNs / 1000.0, span.durationNs / 1000.0);
+    output << (i ? ",\n" : "\n") << "{\"name\":";
+    writeJsonString(output, span.name);
+    output << ",\"cat\":";
+    writeJsonString(output, span.category);
+    output << ",\"ph\":\"X\"," << timing << ",\"pid\":" << pid
+           << ",\"tid\":" << span.threadId << ",\"args\":{\"span_id\":"
+           << span.spanId << ",\"parent_id\":" << span.parentId;
+    if (!span.detail.empty()) {
+      output << ",\"detail\":";
+      writeJsonString(output, span.detail);
+    }
+    output << "}}";
+  }
+  output << "\n]}\n";
+  output.flush();
+  return static_cast<bool>(output);
+}
+
+bool PostgreSQLTrace::writeChromeTrace(const std::string &path) {
+  std::ofstream output(path);
+  return output && writeChromeTrace(output);
+}
+
+bool PostgreSQLTrace::writeOtlpJson(std::ostream &output,
+                                    const std::string &serviceName) {
+  std::vector<TraceSpan> spans = collect();
+  uint64_t offset = unixOffsetNs();
+  uint64_t salt = processTraceSalt();
+  output << "{\"resourceSpans\":[{\"resource\":{\"attributes\":["
+            "{\"key\":\"service.name\",\"value\":{\"stringValue\":";
+  writeJsonString(output, serviceName);
+  output << "}}]},\"scopeSpans\":[{\"scope\":{\"name\":\"pqxx-executor\"},"
+            "\"spans\":[";
+  for (size_t i = 0; i < spans.size(); ++i) {
+    const TraceSpan &span = spans[i];
+    uint64_t start = span.startNs + offset;
+    output << (i ? ",\n" : "\n") << "{\"traceId\":\""
+           << hexId(salt, span.traceId, true) << "\",\"spanId\":\""
+           << hexId(0, span.spanId, false) << "\"";
+    if (span.parentId) {
+      output << ",\"parentSpanId\":\"" << hexId(0, span.parentId, false)
+             << "\"";
+    }
+    output << ",\"name\":";
+    writeJsonString(output, span.name);
+    // SPAN_KIND_CLIENT
+    output << ",\"kind\":3,\"startTimeUnixNano\":\"" << start
+           << "\",\"endTimeUnixNano\":\"" << start + span.durationNs
+           << "\",\"attributes\":[{\"key\":\"category\",\"value\":"
+              "{\"stringValue\":";
+    writeJsonString(output, span.category);
+    output << "}},{\"key\":\"thread.id\",\"value\":{\"intValue\":\""
+           << span.threadId << "\"}}";
+    if (!span.detail.empty()) {
+      output << ",{\"key\":\"db.statement\",\"value\":{\"stringValue\":";
+      writeJsonString(output, span.detail);
+      output << "}}";
+    }
+    output << "]}";
+  }
+  output << "\n]}]}]}\n";
+  output.flush();
+  return static_cast<bool>(output);
+}
+
+bool PostgreSQLTrace::writeOtlpJson(const std::string &path,
+                                    const std::string &serviceName) {
+  std::ofstream output(path);
+  return output && writeOtlpJson(output, serviceName);
+}
+
+TraceScope::TraceScope(const char *spanName, const char *spanCategory,
+                       std::string_view spanDetail)
+    : name(spanName), category(spanCategory), traceId(0), spanId(0),
+      parentId(0), startNs(0), active(PostgreSQLTrace::isEnabled()) {
+  if (!active) {
+    return;
+  }
+  // Statement text is kept short; the span is about timing, not logging.
+  detail.assign(spanDetail.substr(0, 1024));
+  spanId = nextSpanId.fetch_add(1, std::memory_order_relaxed);
+  parentId = currentSpanId;
+  traceId = parentId ? currentTraceId : spanId;
+  currentTraceId = traceId;
+  currentSpanId = spanId;
+  startNs = PostgreSQLTrace::nowNs();
+}
+
+TraceScope::~TraceScope() {
+  if (!active) {
+    return;
+  }
+  uint64_t endNs = PostgreSQLTrace::nowNs();
+  currentSpanId = parentId;
+  if (!parentId) {
+    currentTraceId = 0;
+  }
+  PostgreSQLTrace::record(TraceSpan{name, category, std::move(detail), traceId,
+                                    spanId, parentId, startNs,
+                                    endNs - startNs, 0});
+}
@@ -1,6 +1,16 @@
 #include "../include/PostgreSQLUtils.h"
-#include <iomanip>
+#include "../include/PostgreSQLParamArray.h"
+#include "../include/PostgreSQLSerializer.h"
+#include "../include/PostgreSQLTrace.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
 
 PGResultWrapper::~PGResultWrapper() {
   if (result) {
@@ -43,24 +53,52 @@ void PGResultWrapper::reset(PGresult *res) {
   result = res;
 }
 
+ResultColumns::ResultColumns(std::vector<std::string> columnNames)
+    : names(std::move(columnNames)) {
+  for (size_t i = 0; i < names.size(); ++i) {
+    indexMap[names[i]] = static_cast<int>(i);
+  }
+}
+
 ResultRow::ResultRow() = default;
 
 ResultRow::ResultRow(const std::vector<std::string> &colNames,
                      const std::vector<std::string> &rowValues)
-    : values(rowValues), columns(colNames) {
-  for (size_t i = 0; i < columns.size(); ++i) {
-    columnIndexMap[columns[i]] = static_cast<int>(i);
+    : values(rowValues),
+      columns(std::make_shared<const ResultColumns>(colNames)) {}
+
+ResultRow::ResultRow(std::shared_ptr<const ResultColumns> sharedColumns,
+                     std::vector<std::string> rowValues)
+    : values(std::move(rowValues)), columns(std::move(sharedColumns)) {}
+
+int ResultRow::findColumn(std::string_view columnName) const {
+  if (!columns) {
+    return -1;
+  }
+  auto it = columns->indexMap.find(columnName);
+  if (it != columns->indexMap.end() &&
+      it->second < static_cast<int>(values.size())) {
+    return it->second;
   }
+  return -1;
 }
 
 std::string ResultRow::getString(const std::string &columnName,
                                  const std::string &defaultValue) const {
-  auto it = columnIndexMap.find(columnName);
-  if (it != columnIndexMap.end() &&
-      it->second < static_cast<int>(values.size())) {
-    return values[it->second];
+  int index = findColumn(columnName);
+  return index >= 0 ? values[index] : defaultValue;
+}
+
+std::string_view ResultRow::getView(std::string_view columnName) const {
+  int index = findColumn(columnName);
+  return index >= 0 ? std::string_view(values[index]) : std::string_view();
+}
+
+std::string_view ResultRow::getView(int columnIndex) const {
+  if (columnIndex >= 0 && columnIndex < static_cast<int>(values.size())) {
+    return values[columnIndex];
   }
-  return defaultValue;
+  return {};
 }
 
 std::string ResultRow::getString(int columnIndex,
@@ -144,7 +182,7 @@ bool ResultRow::isNull(int columnIndex) const {
 }
 
 bool ResultRow::hasColumn(const std::string &columnName) const {
-  return columnIndexMap.find(columnName) != columnIndexMap.end();
+  return columns && columns->indexMap.find(columnName) != columns->indexMap.end();
 }
 
 int ResultRow::getColumnCount() const {
@@ -155,17 +193,192 @@ bool ResultRow::isEmpty() const { return values.empty(); }
 
 const std::vector<std::string> &ResultRow::getValues() const { return values; }
 
+static const std::vector<std::string> noColumns;
+
 const std::vector<std::string> &ResultRow::getColumns() const {
-  return columns;
-}
+  return columns ? columns->names : noColumns;
+}
+
+static std::atomic<size_t> defaultMemoryBudget(0);
+static std::atomic<size_t> globalMemoryBudget(0);
+static std::atomic<size_t> globalMemoryUsage(0);
+static std::atomic<bool> spillEnabled(false);
+
+// Spill format: per row, every value is a native uint32 length followed by
+// the value bytes. Row start offsets stay in memory (8 bytes per row).
+class ResultSpillFile {
+private:
+  int fd;
+  std::unique_ptr<OutputBuffer> writer;
+  std::vector<uint64_t> offsets;
+  uint64_t bytesWritten;
+  const char *mapping;
+
+public:
+  ResultSpillFile() : fd(-1), bytesWritten(0), mapping(nullptr) {}
+  ~ResultSpillFile() {
+    if (mapping) {
+      munmap(const_cast<char *>(mapping), bytesWritten);
+    }
+    writer.reset();
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  ResultSpillFile(const ResultSpillFile &) = delete;
+  ResultSpillFile &operator=(const ResultSpillFile &) = delete;
+
+  bool open() {
+    const char *dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir && *dir ? dir : "/tmp") +
+                       "/pqxx-executor-spill-XXXXXX";
+    fd = mkstemp(path.data());
+    if (fd < 0) {
+      return false;
+    }
+    // The file only lives as long as the descriptor.
+    unlink(path.c_str());
+    writer = std::make_unique<OutputBuffer>(fd, 1 << 20);
+    return true;
+  }
+
+  bool appendRow(PGresult *result, int row, int colCount) {
+    offsets.push_back(bytesWritten);
+    for (int col = 0; col < colCount; ++col) {
+      uint32_t length = static_cast<uint32_t>(PQgetlength(result, row, col));
+      writer->append(reinterpret_cast<const char *>(&length), sizeof(length));
+      writer->append(PQgetvalue(result, row, col), length);
+      bytesWritten += sizeof(length) + length;
+    }
+    return !writer->hasError();
+  }
+
+  bool finish() {
+    if (!writer) {
+      return true;
+    }
+    bool ok = writer->flush();
+    writer.reset();
+    if (!ok) {
+      return false;
+    }
+    if (bytesWritten == 0) {
+      return true;
+    }
+    void *mapped =
+        mmap(nullptr, bytesWritten, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      return false;
+    }
+    mapping = static_cast<const char *>(mapped);
+    return true;
+  }
+
+  size_t getRowCount() const { return offsets.size(); }
 
-QueryResult::QueryResult() : affectedRows(0) {}
+  std::vector<std::string> readRow(size_t index, size_t colCount) const {
+    std::vector<std::string> values;
+    values.reserve(colCount);
+    const char *cursor = mapping + offsets[index];
+    for (size_t col = 0; col < colCount; ++col) {
+      uint32_t length;
+      std::memcpy(&length, cursor, sizeof(length));
+      cursor += sizeof(length);
+      values.emplace_back(cursor, length);
+      cursor += length;
+    }
+    return values;
+  }
+};
 
-QueryResult::QueryResult(PGresult *result) : affectedRows(0) {
+QueryResult::QueryResult()
+    : affectedRows(0), memoryBudget(0), memoryUsage(0), columnOverhead(0),
+      spilledRowIndex(SIZE_MAX) {}
+
+QueryResult::QueryResult(PGresult *result) : QueryResult() {
   loadFromResult(result);
 }
 
+QueryResult::~QueryResult() { releaseMemory(); }
+
+QueryResult::QueryResult(const QueryResult &other)
+    : rows(other.rows), columns(other.columns),
+      affectedRows(other.affectedRows), errorMessage(other.errorMessage),
+      memoryBudget(other.memoryBudget), memoryUsage(other.memoryUsage),
+      columnOverhead(other.columnOverhead), spill(other.spill),
+      pinnedRows(other.pinnedRows), spilledRowIndex(SIZE_MAX) {
+  // A copy holds its own rows, so it is charged against the global budget
+  // even if that overshoots it; only loading is refused.
+  globalMemoryUsage.fetch_add(memoryUsage);
+}
+
+QueryResult &QueryResult::operator=(const QueryResult &other) {
+  if (this != &other) {
+    QueryResult copy(other);
+    *this = std::move(copy);
+  }
+  return *this;
+}
+
+QueryResult::QueryResult(QueryResult &&other) noexcept
+    : rows(std::move(other.rows)), columns(std::move(other.columns)),
+      affectedRows(other.affectedRows),
+      errorMessage(std::move(other.errorMessage)),
+      memoryBudget(other.memoryBudget), memoryUsage(other.memoryUsage),
+      columnOverhead(other.columnOverhead), spill(std::move(other.spill)),
+      pinnedRows(std::move(other.pinnedRows)), spilledRowIndex(SIZE_MAX) {
+  other.memoryUsage = 0;
+  other.clear();
+}
+
+QueryResult &QueryResult::operator=(QueryResult &&other) noexcept {
+  if (this != &other) {
+    releaseMemory();
+    rows = std::move(other.rows);
+    columns = std::move(other.columns);
+    affectedRows = other.affectedRows;
+    errorMessage = std::move(other.errorMessage);
+    memoryBudget = other.memoryBudget;
+    memoryUsage = other.memoryUsage;
+    columnOverhead = other.columnOverhead;
+    spill = std::move(other.spill);
+    pinnedRows = std::move(other.pinnedRows);
+    spilledRowIndex = SIZE_MAX;
+    other.memoryUsage = 0;
+    other.clear();
+  }
+  return *this;
+}
+
+bool QueryResult::reserveMemory(size_t bytes) {
+  size_t budget = memoryBudget ? memoryBudget : defaultMemoryBudget.load();
+  if (budget && memoryUsage + bytes > budget) {
+    return false;
+  }
+  size_t globalBudget = globalMemoryBudget.load();
+  if (globalBudget) {
+    size_t used = globalMemoryUsage.load();
+    do {
+      if (used + bytes > globalBudget) {
+        return false;
+      }
+    } while (!globalMemoryUsage.compare_exchange_weak(used, used + bytes));
+  } else {
+    globalMemoryUsage.fetch_add(bytes);
+  }
+  memoryUsage += bytes;
+  return true;
+}
+
+void QueryResult::releaseMemory() {
+  if (memoryUsage) {
+    globalMemoryUsage.fetch_sub(memoryUsage);
+    memoryUsage = 0;
+  }
+}
+
 bool QueryResult::loadFromResult(PGresult *result) {
+  PQXX_TRACE_SPAN("result.load", "result");
   clear();
   if (!result) {
     errorMessage = "Null result pointer";
@@ -178,20 +391,13 @@ bool QueryResult::loadFromResult(PGresult *result) {
 
   ExecStatusType status = PQresultStatus(result);
   if (status == PGRES_TUPLES_OK) {
-    columnNames = PostgreSQLUtils::getColumnNames(result);
-    int rowCount = PostgreSQLUtils::getRowCount(result);
-    int colCount = PostgreSQLUtils::getColumnCount(result);
-    for (int i = 0; i < rowCount; ++i) {
-      std::vector<std::string> rowValues;
-      for (int j = 0; j < colCount; ++j) {
-        rowValues.push_back(PostgreSQLUtils::getValue(result, i, j));
-      }
-      rows.emplace_back(columnNames, rowValues);
-    }
-    affectedRows = rowCount;
+    setColumns(result);
+    bool loaded = appendRows(result) && finishRows();
+    affectedRows = PostgreSQLUtils::getRowCount(result);
+    return loaded;
   } else if (status == PGRES_COMMAND_OK) {
     char *affected = PQcmdTuples(result);
-    if (affected) {
+    if (affected && *affected) {
       affectedRows = std::stoi(affected);
     }
   } else {
@@ -201,11 +407,91 @@ bool QueryResult::loadFromResult(PGresult *result) {
   return true;
 }
 
+void QueryResult::setColumns(PGresult *result) {
+  std::vector<std::string> names;
+  int colCount = PQnfields(result);
+  names.reserve(colCount);
+  for (int i = 0; i < colCount; ++i) {
+    names.emplace_back(PQfname(result, i));
+  }
+  auto shared = std::make_shared<ResultColumns>(std::move(names));
+  shared->types.reserve(colCount);
+  for (int i = 0; i < colCount; ++i) {
+    shared->types.push_back(PQftype(result, i));
+  }
+  // Rows share the column metadata, so only the row itself is per-row cost.
+  columns = std::move(shared);
+  columnOverhead = sizeof(ResultRow);
+}
+
+bool QueryResult::appendRows(PGresult *result) {
+  int rowCount = PQntuples(result);
+  int colCount = PQnfields(result);
+  for (int i = 0; i < rowCount; ++i) {
+    if (!spill) {
+      size_t rowBytes = columnOverhead;
+      for (int j = 0; j < colCount; ++j) {
+        rowBytes += sizeof(std::string) + PQgetlength(result, i, j);
+      }
+      if (reserveMemory(rowBytes)) {
+        std::vector<std::string> rowValues;
+        rowValues.reserve(colCount);
+        for (int j = 0; j < colCount; ++j) {
+          rowValues.emplace_back(PQgetvalue(result, i, j),
+                                 PQgetlength(result, i, j));
+        }
+        rows.emplace_back(columns, std::move(rowValues));
+        continue;
+      }
+    }
+    if (!spillRow(result, i, colCount)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool QueryResult::spillRow(PGresult *result, int row, int colCount) {
+  if (!spillEnabled.load()) {
+    errorMessage = "Memory budget exceeded";
+    return false;
+  }
+  if (!spill) {
+    auto file = std::make_shared<ResultSpillFile>();
+    if (!file->open()) {
+      errorMessage = "Memory budget exceeded and spill file creation failed";
+      return false;
+    }
+    spill = std::move(file);
+  }
+  if (!spill->appendRow(result, row, colCount)) {
+    errorMessage = "Failed to write spill file";
+    return false;
+  }
+  return true;
+}
+
+bool QueryResult::finishRows() {
+  if (spill && !spill->finish()) {
+    errorMessage = "Failed to map spill file";
+    return false;
+  }
+  return true;
+}
+
+void QueryResult::setAffectedRows(int count) { affectedRows = count; }
+
 void QueryResult::clear() {
   rows.clear();
-  columnNames.clear();
+  columns.reset();
   affectedRows = 0;
   errorMessage.clear();
+  releaseMemory();
+  columnOverhead = 0;
+  spill.reset();
+  pinnedRows.clear();
+  spilledRow = ResultRow();
+  spilledRowIndex = SIZE_MAX;
 }
 
 const ResultRow &QueryResult::getRow(size_t index) const {
@@ -213,6 +499,20 @@ const ResultRow &QueryResult::getRow(size_t index) const {
   if (index < rows.size()) {
     return rows[index];
   }
+  if (index < getRowCount()) {
+    auto pinned = pinnedRows.find(index);
+    if (pinned != pinnedRows.end()) {
+      return pinned->second;
+    }
+    // Spilled rows are decoded into a single cached row; the reference
+    // stays valid until the next spilled row is requested.
+    if (spilledRowIndex != index) {
+      spilledRow = ResultRow(
+          columns, spill->readRow(index - rows.size(), getColumnCount()));
+      spilledRowIndex = index;
+    }
+    return spilledRow;
+  }
   return emptyRow;
 }
 
@@ -221,22 +521,81 @@ ResultRow &QueryResult::getRow(size_t index) {
   if (index < rows.size()) {
     return rows[index];
   }
+  if (index < getRowCount()) {
+    // A spilled row handed out for writing is copied into memory for good,
+    // so the writes stick and the reference outlives later getRow calls.
+    auto pinned = pinnedRows.find(index);
+    if (pinned == pinnedRows.end()) {
+      ResultRow row(columns,
+                    spill->readRow(index - rows.size(), getColumnCount()));
+      size_t rowBytes = columnOverhead;
+      for (const auto &value : row.getValues()) {
+        rowBytes += sizeof(std::string) + value.size();
+      }
+      // Charged like a copy: it may overshoot the budget.
+      memoryUsage += rowBytes;
+      globalMemoryUsage.fetch_add(rowBytes);
+      pinned = pinnedRows.emplace(index, std::move(row)).first;
+    }
+    return pinned->second;
+  }
   return emptyRow;
 }
 
-const std::vector<ResultRow> &QueryResult::getAllRows() const { return rows; }
+const std::vector<ResultRow> &QueryResult::getAllRows() const {
+  if (spill) {
+    throw std::logic_error(
+        "getAllRows() on a spilled result; use forEachRow() or getRow()");
+  }
+  return rows;
+}
+
+bool QueryResult::forEachRow(
+    const std::function<bool(const ResultRow &)> &visit) const {
+  for (const ResultRow &row : rows) {
+    if (!visit(row)) {
+      return false;
+    }
+  }
+  if (spill) {
+    // Decoded into a local row so concurrent readers never share a slot.
+    for (size_t i = 0; i < spill->getRowCount(); ++i) {
+      auto pinned = pinnedRows.find(rows.size() + i);
+      if (pinned != pinnedRows.end()) {
+        if (!visit(pinned->second)) {
+          return false;
+        }
+        continue;
+      }
+      ResultRow row(columns, spill->readRow(i, getColumnCount()));
+      if (!visit(row)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
 
 const std::vector<std::string> &QueryResult::getColumnNames() const {
-  return columnNames;
+  return columns ? columns->names : noColumns;
 }
 
-size_t QueryResult::getRowCount() const { return rows.size(); }
+const std::vector<Oid> &QueryResult::getColumnTypes() const {
+  static const std::vector<Oid> noTypes;
+  return columns ? columns->types : noTypes;
+}
 
-size_t QueryResult::getColumnCount() const { return columnNames.size(); }
+size_t QueryResult::getRowCount() const {
+  return rows.size() + getSpilledRowCount();
+}
+
+size_t QueryResult::getColumnCount() const {
+  return columns ? columns->names.size() : 0;
+}
 
 int QueryResult::getAffectedRows() const { return affectedRows; }
 
-bool QueryResult::hasData() const { return !rows.empty(); }
+bool QueryResult::hasData() const { return getRowCount() > 0; }
 
 bool QueryResult::hasError() const { return !errorMessage.empty(); }
 
@@ -246,63 +605,231 @@ void QueryResult::setErrorMessage(const std::string &error) {
   errorMessage = error;
 }
 
-ResultRow QueryResult::getFirstRow() const {
-  if (!rows.empty()) {
-    return rows[0];
-  }
-  return ResultRow();
-}
+ResultRow QueryResult::getFirstRow() const { return getRow(0); }
 
 std::string QueryResult::getFirstValue(const std::string &columnName,
                                        const std::string &defaultValue) const {
-  if (!rows.empty()) {
-    return rows[0].getString(columnName, defaultValue);
+  if (hasData()) {
+    return getRow(0).getString(columnName, defaultValue);
   }
   return defaultValue;
 }
 
 int QueryResult::getFirstInt(const std::string &columnName,
                              int defaultValue) const {
-  if (!rows.empty()) {
-    return rows[0].getInt(columnName, defaultValue);
+  if (hasData()) {
+    return getRow(0).getInt(columnName, defaultValue);
   }
   return defaultValue;
 }
 
-QueryResult PostgreSQLUtils::executeQuery(PostgreSQLConnection &connection,
-                                          const std::string &query) {
+void QueryResult::setMemoryBudget(size_t bytes) { memoryBudget = bytes; }
+
+size_t QueryResult::getMemoryUsage() const { return memoryUsage; }
+
+bool QueryResult::isSpilled() const { return spill != nullptr; }
+
+size_t QueryResult::getSpilledRowCount() const {
+  return spill ? spill->getRowCount() : 0;
+}
+
+void QueryResult::setDefaultMemoryBudget(size_t bytes) {
+  defaultMemoryBudget.store(bytes);
+}
+
+size_t QueryResult::getDefaultMemoryBudget() {
+  return defaultMemoryBudget.load();
+}
+
+void QueryResult::setGlobalMemoryBudget(size_t bytes) {
+  globalMemoryBudget.store(bytes);
+}
+
+size_t QueryResult::getGlobalMemoryBudget() {
+  return globalMemoryBudget.load();
+}
+
+size_t QueryResult::getGlobalMemoryUsage() {
+  return globalMemoryUsage.load();
+}
+
+void QueryResult::setSpillEnabled(bool enabled) {
+  spillEnabled.store(enabled);
+}
+
+bool QueryResult::isSpillEnabled() { return spillEnabled.load(); }
+
+bool QueryResult::isMemoryBudgetActive() {
+  return defaultMemoryBudget.load() || globalMemoryBudget.load();
+}
+
+static bool isCopyStatus(ExecStatusType status) {
+  return status == PGRES_COPY_IN || status == PGRES_COPY_OUT ||
+         status == PGRES_COPY_BOTH;
+}
+
+// PQgetResult keeps returning the COPY result until the copy is over, so
+// leave COPY mode: COPY FROM STDIN is aborted with an error and COPY TO
+// STDOUT data is read and dropped. The caller then drains the results.
+static void abortCopy(PGconn *conn, ExecStatusType status) {
+  if (status == PGRES_COPY_IN || status == PGRES_COPY_BOTH) {
+    PQputCopyEnd(conn, "COPY is not supported by PostgreSQLUtils");
+  }
+  if (status == PGRES_COPY_OUT || status == PGRES_COPY_BOTH) {
+    char *buffer = nullptr;
+    while (PQgetCopyData(conn, &buffer, 0) > 0) {
+      PQfreemem(buffer);
+      buffer = nullptr;
+    }
+  }
+}
+
+// Drains a query sent with PQsendQuery*/ in single-row mode so that at most
+// one row is held by libpq while QueryResult enforces its budget.
+static void fetchRowsIncrementally(PGconn *conn, QueryResult &result) {
+  PQXX_TRACE_SPAN("result.fetch", "result");
+  PQsetSingleRowMode(conn);
+  // Like PQexec, only the last result set of a multi-statement string is
+  // kept; each new one starts from an empty result.
+  bool newResultSet = true;
+  bool failed = false;
+  int total = 0;
+  while (PGresult *raw = PQgetResult(conn)) {
+    PGResultWrapper part(raw);
+    if (failed) {
+      continue;
+    }
+    ExecStatusType status = PQresultStatus(raw);
+    if (status == PGRES_SINGLE_TUPLE || status == PGRES_TUPLES_OK) {
+      if (newResultSet) {
+        result.clear();
+        result.setColumns(raw);
+        total = 0;
+        newResultSet = false;
+      }
+      total += PQntuples(raw);
+      failed = !result.appendRows(raw);
+      if (!failed && status == PGRES_TUPLES_OK) {
+        failed = !result.finishRows();
+        result.setAffectedRows(total);
+        newResultSet = true;
+      }
+    } else if (status == PGRES_COMMAND_OK) {
+      result.loadFromResult(raw);
+      newResultSet = true;
+    } else if (isCopyStatus(status)) {
+      abortCopy(conn, status);
+      result.clear();
+      result.setErrorMessage("COPY is not supported by PostgreSQLUtils");
+      failed = true;
+    } else {
+      result.clear();
+      result.setErrorMessage(PostgreSQLUtils::resultStatusToString(status));
+      failed = true;
+    }
+  }
+  if (failed) {
+    std::string error = result.getErrorMessage();
+    result.clear();
+    result.setErrorMessage(error);
+  }
+}
+
+// Shared path for every executeQuery* overload. Simple-query protocol is used
+// when extended is false so multi-statement strings keep working.
+static QueryResult runQuery(PostgreSQLConnection &connection, const char *query,
+                            bool extended, int paramCount,
+                            const char *const *paramValues,
+                            size_t memoryBudget) {
+  PQXX_TRACE_SPAN_DETAIL("query.execute", "query", query);
   QueryResult result;
   if (!connection.isOK()) {
     result.setErrorMessage("Connection is not established");
     return result;
   }
-  PGResultWrapper wrapper(PQexec(connection.getRawConnection(), query.c_str()));
-  result.loadFromResult(wrapper.get());
+  PGconn *conn = connection.getRawConnection();
+  result.setMemoryBudget(memoryBudget);
+  if (!memoryBudget && !QueryResult::isMemoryBudgetActive()) {
+    PGResultWrapper wrapper(
+        extended ? PQexecParams(conn, query, paramCount, nullptr, paramValues,
+                                nullptr, nullptr, 0)
+                 : PQexec(conn, query));
+    ExecStatusType status = PQresultStatus(wrapper.get());
+    if (isCopyStatus(status)) {
+      abortCopy(conn, status);
+      while (PGresult *rest = PQgetResult(conn)) {
+        PQclear(rest);
+      }
+      result.setErrorMessage("COPY is not supported by PostgreSQLUtils");
+      return result;
+    }
+    result.loadFromResult(wrapper.get());
+    return result;
+  }
+  int sent = extended ? PQsendQueryParams(conn, query, paramCount, nullptr,
+                                          paramValues, nullptr, nullptr, 0)
+                      : PQsendQuery(conn, query);
+  if (!sent) {
+    result.setErrorMessage(connection.getLastError());
+    return result;
+  }
+  fetchRowsIncrementally(conn, result);
   return result;
 }
 
+QueryResult PostgreSQLUtils::executeQuery(PostgreSQLConnection &connection,
+                                          const std::string &query,
+                                          size_t memoryBudget) {
+  return runQuery(connection, query.c_str(), false, 0, nullptr, memoryBudget);
+}
+
+QueryResult PostgreSQLUtils::executeQuery(PostgreSQLConnection &connection,
+                                          const char *query,
+                                          size_t memoryBudget) {
+  return runQuery(connection, query, false, 0, nullptr, memoryBudget);
+}
+
+QueryResult PostgreSQLUtils::executeQuery(PostgreSQLConnection &connection,
+                                          std::string_view query,
+                                          size_t memoryBudget) {
+  NullTerminatedText text(query);
+  return runQuery(connection, text.c_str(), false, 0, nullptr, memoryBudget);
+}
+
 QueryResult
 PostgreSQLUtils::executeQueryParams(PostgreSQLConnection &connection,
                                     const std::string &query,
-                                    const std::vector<std::string> &params) {
-  QueryResult result;
-  if (!connection.isOK()) {
-    result.setErrorMessage("Connection is not established");
-    return result;
-  }
-  std::vector<const char *> paramValues;
-  for (const auto &param : params) {
-    paramValues.push_back(param.c_str());
-  }
-  PGResultWrapper wrapper(PQexecParams(
-      connection.getRawConnection(), query.c_str(), params.size(), nullptr,
-      paramValues.empty() ? nullptr : paramValues.data(), nullptr, nullptr, 0));
-  result.loadFromResult(wrapper.get());
-  return result;
+                                    const std::vector<std::string> &params,
+                                    size_t memoryBudget) {
+  ParamArray values{std::span<const std::string>(params)};
+  return runQuery(connection, query.c_str(), true, values.size(),
+                  values.data(), memoryBudget);
+}
+
+QueryResult
+PostgreSQLUtils::executeQueryParams(PostgreSQLConnection &connection,
+                                    std::string_view query,
+                                    std::span<const std::string_view> params,
+                                    size_t memoryBudget) {
+  NullTerminatedText text(query);
+  ParamArray values(params);
+  return runQuery(connection, text.c_str(), true, values.size(),
+                  values.data(), memoryBudget);
+}
+
+QueryResult PostgreSQLUtils::executeQueryParams(
+    PostgreSQLConnection &connection, std::string_view query,
+    std::span<const std::optional<std::string_view>> params,
+    size_t memoryBudget) {
+  NullTerminatedText text(query);
+  ParamArray values(params);
+  return runQuery(connection, text.c_str(), true, values.size(),
+                  values.data(), memoryBudget);
 }
 
 void PostgreSQLUtils::printResult(const QueryResult &result,
                                   std::ostream &output) {
+  PQXX_TRACE_SPAN("result.print", "result");
   if (result.hasError()) {
     output << "Error: " << result.getErrorMessage() << std::endl;
     return;
@@ -316,47 +843,29 @@ void PostgreSQLUtils::printResult(const QueryResult &result,
 }
 
 void PostgreSQLUtils::printResult(PGresult *result, std::ostream &output) {
-  QueryResult qr(result);
-  printResult(qr, output);
-}
-
-void PostgreSQLUtils::printResultTable(const QueryResult &result,
-                                       std::ostream &output) {
-  const auto &columnNames = result.getColumnNames();
-  const auto &rows = result.getAllRows();
-  if (columnNames.empty()) {
-    output << "No columns" << std::endl;
+  PQXX_TRACE_SPAN("result.print", "result");
+  if (!result) {
+    output << "Error: Null result pointer" << std::endl;
     return;
   }
-  std::vector<size_t> columnWidths;
-  for (const auto &colName : columnNames) {
-    columnWidths.push_back(colName.length());
-  }
-  for (const auto &row : rows) {
-    const auto &values = row.getValues();
-    for (size_t i = 0; i < values.size() && i < columnWidths.size(); ++i) {
-      if (values[i].length() > columnWidths[i]) {
-        columnWidths[i] = values[i].length();
-      }
-    }
-  }
-  output << std::left;
-  for (size_t i = 0; i < columnNames.size(); ++i) {
-    output << std::setw(columnWidths[i] + 2) << columnNames[i];
-  }
-  output << std::endl;
-  for (size_t i = 0; i < columnNames.size(); ++i) {
-    output << std::string(columnWidths[i] + 2, '-');
+  if (!isResultValid(result)) {
+    output << "Error: Invalid result" << std::endl;
+    return;
   }
-  output << std::endl;
-  for (const auto &row : rows) {
-    const auto &values = row.getValues();
-    for (size_t i = 0; i < values.size() && i < columnWidths.size(); ++i) {
-      output << std::setw(columnWidths[i] + 2) << values[i];
-    }
-    output << std::endl;
+  if (!hasRows(result)) {
+    const char *affected = PQcmdTuples(result);
+    output << "No data returned. Affected rows: "
+           << (affected && *affected ? affected : "0") << std::endl;
+    return;
   }
-  output << "Total rows: " << rows.size() << std::endl;
+  OutputBuffer buffer(output);
+  PostgreSQLSerializer::writeTable(result, buffer);
+}
+
+void PostgreSQLUtils::printResultTable(const QueryResult &result,
+                                       std::ostream &output) {
+  OutputBuffer buffer(output);
+  PostgreSQLSerializer::writeTable(result, buffer);
 }
 
 std::vector<std::string> PostgreSQLUtils::getColumnNames(PGresult *result) {
@@ -388,6 +897,27 @@ std::string PostgreSQLUtils::getValue(PGresult *result, int row, int col,
   return value ? value : defaultValue;
 }
 
+std::string_view PostgreSQLUtils::getValueView(PGresult *result, int row,
+                                               int col) {
+  if (!isResultValid(result) || row < 0 || row >= getRowCount(result) ||
+      col < 0 || col >= getColumnCount(result)) {
+    return {};
+  }
+  return std::string_view(PQgetvalue(result, row, col),
+                          PQgetlength(result, row, col));
+}
+
+std::span<const std::byte> PostgreSQLUtils::getBytes(PGresult *result, int row,
+                                                     int col) {
+  if (!isResultValid(result) || row < 0 || row >= getRowCount(result) ||
+      col < 0 || col >= getColumnCount(result) ||
+      PQfformat(result, col) != 1 || PQgetisnull(result, row, col)) {
+    return {};
+  }
+  return {reinterpret_cast<const std::byte *>(PQgetvalue(result, row, col)),
+          static_cast<size_t>(PQgetlength(result, row, col))};
+}
+
 bool PostgreSQLUtils::isResultValid(PGresult *result) {
   return result && (PQresultStatus(result) == PGRES_TUPLES_OK ||
                     PQresultStatus(result) == PGRES_COMMAND_OK);
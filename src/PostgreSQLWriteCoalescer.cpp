@@ -0,0 +1,287 @@
+#include "../include/PostgreSQLWriteCoalescer.h"
+#include "../include/PostgreSQLParamArray.h"
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+PostgreSQLWriteCoalescer::PostgreSQLWriteCoalescer(
+    PostgreSQLConnection &conn, size_t maxBatchSize,
+    std::chrono::microseconds maxDelay)
+    : connection(conn), maxBatchSize(maxBatchSize ? maxBatchSize : 1),
+      maxDelay(maxDelay), stopping(false), committedBatches(0),
+      committedUnits(0) {
+  if (!connection.isOK()) {
+    throw std::runtime_error("Database connection is not established");
+  }
+  writer = std::thread(&PostgreSQLWriteCoalescer::writerLoop, this);
+}
+
+PostgreSQLWriteCoalescer::~PostgreSQLWriteCoalescer() { shutdown(); }
+
+std::future<QueryResult>
+PostgreSQLWriteCoalescer::submit(const std::string &query,
+                                 const std::vector<std::string> &params) {
+  return submit(std::vector<WriteStatement>{{query, params}});
+}
+
+std::future<QueryResult>
+PostgreSQLWriteCoalescer::submit(std::vector<WriteStatement> statements) {
+  PendingUnit unit;
+  unit.statements = std::move(statements);
+  std::future<QueryResult> future = unit.promise.get_future();
+  if (unit.statements.empty()) {
+    unit.promise.set_value(QueryResult());
+    return future;
+  }
+  size_t queued;
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (stopping) {
+      QueryResult result;
+      result.setErrorMessage("Write coalescer is shut down");
+      unit.promise.set_value(result);
+      return future;
+    }
+    queue.push_back(std::move(unit));
+    queued = queue.size();
+  }
+  // Wake the writer when a window opens and again when it fills up.
+  if (queued == 1 || queued >= maxBatchSize) {
+    queueCondition.notify_one();
+  }
+  return future;
+}
+
+void PostgreSQLWriteCoalescer::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    stopping = true;
+  }
+  queueCondition.notify_one();
+  if (writer.joinable()) {
+    writer.join();
+  }
+}
+
+size_t PostgreSQLWriteCoalescer::getPendingCount() {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return queue.size();
+}
+
+size_t PostgreSQLWriteCoalescer::getCommittedBatches() {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return committedBatches;
+}
+
+size_t PostgreSQLWriteCoalescer::getCommittedUnits() {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return committedUnits;
+}
+
+void PostgreSQLWriteCoalescer::writerLoop() {
+  std::vector<PendingUnit> batch;
+  batch.reserve(maxBatchSize);
+  std::unique_lock<std::mutex> lock(queueMutex);
+  while (true) {
+    queueCondition.wait(lock, [this] { return stopping || !queue.empty(); });
+    if (queue.empty()) {
+      return;
+    }
+    // The window starts with the first pending unit and closes after
+    // maxDelay or as soon as a full batch is available.
+    auto deadline = std::chrono::steady_clock::now() + maxDelay;
+    queueCondition.wait_until(lock, deadline, [this] {
+      return stopping || queue.size() >= maxBatchSize;
+    });
+    while (!queue.empty() && batch.size() < maxBatchSize) {
+      batch.push_back(std::move(queue.front()));
+      queue.pop_front();
+    }
+    lock.unlock();
+    size_t units = batch.size();
+    bool committed = false;
+    try {
+      flushBatch(batch);
+      committed = true;
+    } catch (const std::exception &e) {
+      std::cerr << "Write coalescer batch failed: " << e.what() << std::endl;
+    }
+    batch.clear();
+    lock.lock();
+    if (committed) {
+      ++committedBatches;
+      committedUnits += units;
+    }
+  }
+}
+
+namespace {
+
+// What each command sent in a pipeline round was, so its results can be
+// matched up when they come back in order.
+enum class PipelineStep {
+  Begin,
+  Recover,
+  Savepoint,
+  Statement,
+  Release,
+  Commit
+};
+
+struct SentCommand {
+  PipelineStep step;
+  size_t unit;
+};
+
+// Reads the results of the next pipelined command up to its terminating
+// null result and returns the last one (nullptr if the connection failed).
+PGresult *readCommandResult(PGconn *conn) {
+  PGresult *last = nullptr;
+  while (PGresult *result = PQgetResult(conn)) {
+    PQclear(last);
+    last = result;
+  }
+  return last;
+}
+
+} // namespace
+
+void PostgreSQLWriteCoalescer::flushBatch(std::vector<PendingUnit> &batch) {
+  auto failAll = [&batch](const std::string &error) {
+    for (auto &unit : batch) {
+      QueryResult result;
+      result.setErrorMessage(error);
+      unit.promise.set_value(result);
+    }
+  };
+  PGconn *conn = connection.getRawConnection();
+  if (!PQenterPipelineMode(conn)) {
+    std::string error = "Cannot enter pipeline mode: " +
+                        connection.getLastError();
+    failAll(error);
+    throw std::runtime_error(error);
+  }
+  // Every round sends the remaining units and the COMMIT as one pipeline,
+  // i.e. one round trip. A failing unit makes the server skip the rest of
+  // the round; the next round rolls back to that unit's savepoint and
+  // resends the units after it. Results are only read after the sync, so
+  // units should not return large row sets.
+  std::vector<QueryResult> results(batch.size());
+  size_t next = 0;
+  bool begun = false;
+  bool recovering = false;
+  while (true) {
+    std::vector<SentCommand> sent;
+    auto send = [&](PipelineStep step, size_t unit, const char *sql,
+                    int paramCount = 0,
+                    const char *const *paramValues = nullptr) {
+      sent.push_back({step, unit});
+      return PQsendQueryParams(conn, sql, paramCount, nullptr, paramValues,
+                               nullptr, nullptr, 0) == 1;
+    };
+    bool queued = begun || send(PipelineStep::Begin, 0, "BEGIN");
+    if (queued && recovering) {
+      queued =
+          send(PipelineStep::Recover, 0,
+               "ROLLBACK TO SAVEPOINT coalesced_write") &&
+          send(PipelineStep::Recover, 0, "RELEASE SAVEPOINT coalesced_write");
+    }
+    for (size_t i = next; queued && i < batch.size(); ++i) {
+      queued = send(PipelineStep::Savepoint, i, "SAVEPOINT coalesced_write");
+      for (const auto &statement : batch[i].statements) {
+        if (!queued) {
+          break;
+        }
+        ParamArray values{std::span<const std::string>(statement.params)};
+        queued = send(PipelineStep::Statement, i, statement.query.c_str(),
+                      values.size(), values.data());
+      }
+      queued = queued && send(PipelineStep::Release, i,
+                              "RELEASE SAVEPOINT coalesced_write");
+    }
+    queued = queued && send(PipelineStep::Commit, 0, "COMMIT") &&
+             PQpipelineSync(conn) == 1;
+    if (!queued) {
+      // The pipeline is in an unknown state; start over on a fresh session.
+      std::string error = "Pipeline send failed: " + connection.getLastError();
+      connection.reset();
+      failAll(error);
+      throw std::runtime_error(error);
+    }
+
+    size_t failedUnit = SIZE_MAX;
+    bool committed = false;
+    std::string controlError;
+    for (const SentCommand &command : sent) {
+      PGResultWrapper result(readCommandResult(conn));
+      ExecStatusType status = PQresultStatus(result.get());
+      bool ok = status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK;
+      if (status == PGRES_PIPELINE_ABORTED || failedUnit != SIZE_MAX ||
+          !controlError.empty()) {
+        continue;
+      }
+      if (command.step == PipelineStep::Statement) {
+        QueryResult &unitResult = results[command.unit];
+        if (ok) {
+          unitResult.loadFromResult(result.get());
+        } else {
+          failedUnit = command.unit;
+          unitResult.clear();
+          unitResult.setErrorMessage(
+              result ? PQresultErrorMessage(result.get())
+                     : connection.getLastError());
+        }
+      } else if (command.step == PipelineStep::Commit) {
+        committed = ok && std::strcmp(PQcmdStatus(result.get()), "COMMIT") == 0;
+        if (!committed) {
+          controlError = "COMMIT failed: " + connection.getLastError();
+        }
+      } else if (!ok) {
+        controlError = "Transaction control failed: " +
+                       std::string(result ? PQresultErrorMessage(result.get())
+                                          : connection.getLastError());
+      }
+    }
+    // The sync result closes the round.
+    while (true) {
+      PGresult *raw = PQgetResult(conn);
+      if (!raw) {
+        if (connection.getStatus() != CONNECTION_OK) {
+          std::string error = "Connection lost: " + connection.getLastError();
+          failAll(error);
+          throw std::runtime_error(error);
+        }
+        continue;
+      }
+      ExecStatusType status = PQresultStatus(raw);
+      PQclear(raw);
+      if (status == PGRES_PIPELINE_SYNC) {
+        break;
+      }
+    }
+
+    if (!controlError.empty()) {
+      PQexitPipelineMode(conn);
+      if (PQtransactionStatus(conn) != PQTRANS_IDLE) {
+        connection.rollbackTransaction();
+      }
+      failAll(controlError);
+      throw std::runtime_error(controlError);
+    }
+    if (failedUnit == SIZE_MAX) {
+      break;
+    }
+    begun = true;
+    recovering = true;
+    next = failedUnit + 1;
+  }
+  PQexitPipelineMode(conn);
+  // Results only become visible to the submitters once the whole batch is
+  // durable; a failed COMMIT fails every unit in it.
+  for (size_t i = 0; i < batch.size(); ++i) {
+    batch[i].promise.set_value(std::move(results[i]));
+  }
+}
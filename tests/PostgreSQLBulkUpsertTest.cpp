@@ -0,0 +1,74 @@
+#include "PostgreSQLBulkUpsert.h"
+#include "PostgreSQLUtils.h"
+#include "TestSupport.h"
+
+namespace {
+
+class BulkUpsertServerTest : public ServerTest {
+protected:
+  BulkUpsertOptions options;
+
+  void SetUp() override {
+    ServerTest::SetUp();
+    if (IsSkipped() || HasFatalFailure()) {
+      return;
+    }
+    ASSERT_FALSE(PostgreSQLUtils::executeQuery(
+                     connection, "CREATE TEMP TABLE upsert_target "
+                                 "(id int PRIMARY KEY, name text)")
+                     .hasError());
+    options.table = "upsert_target";
+    options.columns = {"id", "name"};
+    options.keyColumns = {"id"};
+  }
+
+  long long count() {
+    return PostgreSQLUtils::executeQuery(
+               connection, "SELECT count(*) AS n FROM upsert_target")
+        .getFirstInt("n");
+  }
+};
+
+} // namespace
+
+TEST_F(BulkUpsertServerTest, NestsInCallersTransaction) {
+  ASSERT_TRUE(connection.beginTransaction());
+  BulkUpsertResult result =
+      PostgreSQLBulkUpsert::run(connection, options, {{"1", "a"}, {"2", "b"}});
+  ASSERT_TRUE(result.success) << result.errorMessage;
+  EXPECT_EQ(result.inserted, 2);
+  // The caller's transaction is still open and decides the outcome.
+  EXPECT_EQ(PQtransactionStatus(connection.getRawConnection()),
+            PQTRANS_INTRANS);
+  ASSERT_TRUE(connection.rollbackTransaction());
+  EXPECT_EQ(count(), 0);
+}
+
+TEST_F(BulkUpsertServerTest, RollbackKeepsCallersTransaction) {
+  ASSERT_TRUE(connection.beginTransaction());
+  ASSERT_FALSE(PostgreSQLUtils::executeQuery(
+                   connection, "INSERT INTO upsert_target VALUES (9, 'x')")
+                   .hasError());
+  {
+    PostgreSQLBulkUpsert upsert(connection, options);
+    ASSERT_TRUE(upsert.begin());
+    ASSERT_TRUE(upsert.addRow(std::vector<std::string>{"1", "a"}));
+    upsert.rollback();
+  }
+  ASSERT_TRUE(connection.commitTransaction());
+  EXPECT_EQ(count(), 1);
+}
+
+TEST_F(BulkUpsertServerTest, TwoUpsertsOnOneSessionDoNotCollide) {
+  ASSERT_TRUE(connection.beginTransaction());
+  PostgreSQLBulkUpsert first(connection, options);
+  ASSERT_TRUE(first.begin());
+  ASSERT_TRUE(first.addRow(std::vector<std::string>{"1", "a"}));
+  EXPECT_TRUE(first.commit().success);
+  PostgreSQLBulkUpsert second(connection, options);
+  ASSERT_TRUE(second.begin()) << second.getLastError();
+  ASSERT_TRUE(second.addRow(std::vector<std::string>{"2", "b"}));
+  EXPECT_TRUE(second.commit().success);
+  ASSERT_TRUE(connection.commitTransaction());
+  EXPECT_EQ(count(), 2);
+}
@@ -0,0 +1,220 @@
+#include "PostgreSQLChangeStream.h"
+#include <gtest/gtest.h>
+
+// Builds pgoutput protocol messages in network byte order.
+class MessageBuilder {
+private:
+  std::string bytes;
+
+public:
+  MessageBuilder &byte(char value) {
+    bytes += value;
+    return *this;
+  }
+  MessageBuilder &integer(uint64_t value, int size) {
+    for (int shift = (size - 1) * 8; shift >= 0; shift -= 8) {
+      bytes += static_cast<char>((value >> shift) & 0xFF);
+    }
+    return *this;
+  }
+  MessageBuilder &u16(uint16_t value) { return integer(value, 2); }
+  MessageBuilder &u32(uint32_t value) { return integer(value, 4); }
+  MessageBuilder &u64(uint64_t value) { return integer(value, 8); }
+  MessageBuilder &string(const std::string &value) {
+    bytes += value;
+    bytes += '\0';
+    return *this;
+  }
+  MessageBuilder &text(const std::string &value) {
+    byte('t').u32(static_cast<uint32_t>(value.size()));
+    bytes += value;
+    return *this;
+  }
+  const std::string &str() const { return bytes; }
+};
+
+class ChangeStreamDecodeTest : public ::testing::Test {
+protected:
+  PostgreSQLConnection connection;
+  PostgreSQLChangeStream stream{connection, ChangeStreamOptions{}};
+
+  // Wraps a pgoutput message in XLogData and decodes it.
+  bool feed(uint64_t walStart, const std::string &message, ChangeEvent &event,
+            bool &produced) {
+    MessageBuilder frame;
+    frame.byte('w').u64(walStart).u64(walStart).u64(0);
+    std::string data = frame.str() + message;
+    produced = false;
+    return stream.handleCopyData(data.data(), data.size(), event, produced);
+  }
+
+  bool feedRaw(const std::string &data, ChangeEvent &event, bool &produced) {
+    produced = false;
+    return stream.handleCopyData(data.data(), data.size(), event, produced);
+  }
+
+  // Relation 7: public.items (id int4 key, name text).
+  void describeItems() {
+    MessageBuilder relation;
+    relation.byte('R').u32(7).string("public").string("items").byte('d').u16(2);
+    relation.byte(1).string("id").u32(23).u32(0xFFFFFFFF);
+    relation.byte(0).string("name").u32(25).u32(0xFFFFFFFF);
+    ChangeEvent event;
+    bool produced;
+    ASSERT_TRUE(feed(0x100, relation.str(), event, produced));
+    EXPECT_FALSE(produced);
+  }
+};
+
+TEST_F(ChangeStreamDecodeTest, TransactionWithInsert) {
+  ChangeEvent event;
+  bool produced;
+  // Commit time 1 second after the PostgreSQL epoch.
+  ASSERT_TRUE(feed(0x100,
+                   MessageBuilder().byte('B').u64(0x200).u64(1000000).u32(42).str(),
+                   event, produced));
+  ASSERT_TRUE(produced);
+  EXPECT_EQ(event.type, ChangeType::Begin);
+  EXPECT_EQ(event.xid, 42u);
+  EXPECT_EQ(event.commitTime.time_since_epoch(),
+            std::chrono::seconds(946684801));
+
+  describeItems();
+
+  MessageBuilder insert;
+  insert.byte('I').u32(7).byte('N').u16(2).text("1").byte('n');
+  ASSERT_TRUE(feed(0x180, insert.str(), event, produced));
+  ASSERT_TRUE(produced);
+  EXPECT_EQ(event.type, ChangeType::Insert);
+  EXPECT_EQ(event.lsn, 0x180u);
+  EXPECT_EQ(event.xid, 42u);
+  EXPECT_EQ(event.schema, "public");
+  EXPECT_EQ(event.table, "items");
+  ASSERT_EQ(event.newTuple.size(), 2u);
+  EXPECT_EQ(event.newTuple[0].name, "id");
+  EXPECT_EQ(event.newTuple[0].typeOid, 23u);
+  EXPECT_TRUE(event.newTuple[0].isKey);
+  EXPECT_EQ(event.newTuple[0].value, "1");
+  EXPECT_EQ(event.newTuple[1].name, "name");
+  EXPECT_TRUE(event.newTuple[1].isNull);
+  EXPECT_TRUE(event.oldTuple.empty());
+
+  MessageBuilder commit;
+  commit.byte('C').byte(0).u64(0x200).u64(0x228).u64(1000000);
+  ASSERT_TRUE(feed(0x200, commit.str(), event, produced));
+  ASSERT_TRUE(produced);
+  EXPECT_EQ(event.type, ChangeType::Commit);
+  EXPECT_EQ(event.lsn, 0x228u);
+  EXPECT_EQ(stream.getReceivedLsn(), 0x200u);
+}
+
+TEST_F(ChangeStreamDecodeTest, UpdateAndDeleteCarryOldTuples) {
+  describeItems();
+  ChangeEvent event;
+  bool produced;
+  MessageBuilder update;
+  update.byte('U').u32(7).byte('K').u16(2).text("1").byte('n');
+  update.byte('N').u16(2).text("2").byte('u');
+  ASSERT_TRUE(feed(0x300, update.str(), event, produced));
+  ASSERT_TRUE(produced);
+  EXPECT_EQ(event.type, ChangeType::Update);
+  ASSERT_EQ(event.oldTuple.size(), 2u);
+  EXPECT_EQ(event.oldTuple[0].value, "1");
+  ASSERT_EQ(event.newTuple.size(), 2u);
+  EXPECT_EQ(event.newTuple[0].value, "2");
+  EXPECT_TRUE(event.newTuple[1].isUnchanged);
+
+  MessageBuilder remove;
+  remove.byte('D').u32(7).byte('O').u16(2).text("2").text("two");
+  ASSERT_TRUE(feed(0x380, remove.str(), event, produced));
+  ASSERT_TRUE(produced);
+  EXPECT_EQ(event.type, ChangeType::Delete);
+  EXPECT_TRUE(event.newTuple.empty());
+  ASSERT_EQ(event.oldTuple.size(), 2u);
+  EXPECT_EQ(event.oldTuple[1].value, "two");
+}
+
+TEST_F(ChangeStreamDecodeTest, TruncateNamesKnownRelations) {
+  describeItems();
+  ChangeEvent event;
+  bool produced;
+  ASSERT_TRUE(feed(0x400, MessageBuilder().byte('T').u32(1).byte(0).u32(7).str(),
+                   event, produced));
+  ASSERT_TRUE(produced);
+  EXPECT_EQ(event.type, ChangeType::Truncate);
+  ASSERT_EQ(event.truncatedTables.size(), 1u);
+  EXPECT_EQ(event.truncatedTables[0], "public.items");
+}
+
+TEST_F(ChangeStreamDecodeTest, UnknownRelationIsAnError) {
+  ChangeEvent event;
+  bool produced;
+  MessageBuilder insert;
+  insert.byte('I').u32(99).byte('N').u16(0);
+  EXPECT_FALSE(feed(0x100, insert.str(), event, produced));
+  EXPECT_FALSE(produced);
+  EXPECT_TRUE(stream.hasError());
+}
+
+TEST_F(ChangeStreamDecodeTest, TruncatedMessageIsAnError) {
+  describeItems();
+  ChangeEvent event;
+  bool produced;
+  MessageBuilder insert;
+  insert.byte('I').u32(7).byte('N').u16(2).text("1");
+  // Two columns are declared, but the data ends inside the first value.
+  std::string cut = insert.str().substr(0, insert.str().size() - 1);
+  EXPECT_FALSE(feed(0x100, cut, event, produced));
+  EXPECT_FALSE(produced);
+  EXPECT_TRUE(stream.hasError());
+}
+
+TEST_F(ChangeStreamDecodeTest, IgnoresOtherMessages) {
+  ChangeEvent event;
+  bool produced;
+  // Origin message, then an unknown CopyData kind.
+  EXPECT_TRUE(feed(0x100, MessageBuilder().byte('O').u64(1).string("o").str(),
+                   event, produced));
+  EXPECT_FALSE(produced);
+  EXPECT_TRUE(feedRaw("z", event, produced));
+  EXPECT_FALSE(produced);
+  EXPECT_FALSE(stream.hasError());
+}
+
+TEST_F(ChangeStreamDecodeTest, IdleKeepaliveAdvancesAcknowledgedLsn) {
+  ChangeEvent event;
+  bool produced;
+  MessageBuilder keepalive;
+  keepalive.byte('k').u64(0x5000).u64(0).byte(0);
+  ASSERT_TRUE(feedRaw(keepalive.str(), event, produced));
+  EXPECT_FALSE(produced);
+  EXPECT_EQ(stream.getReceivedLsn(), 0x5000u);
+  EXPECT_EQ(stream.getAcknowledgedLsn(), 0x5000u);
+
+  // Inside a transaction the position must not move past unprocessed data.
+  ASSERT_TRUE(feed(0x5100,
+                   MessageBuilder().byte('B').u64(0x6000).u64(0).u32(9).str(),
+                   event, produced));
+  MessageBuilder later;
+  later.byte('k').u64(0x7000).u64(0).byte(0);
+  ASSERT_TRUE(feedRaw(later.str(), event, produced));
+  EXPECT_EQ(stream.getAcknowledgedLsn(), 0x5000u);
+}
+
+TEST(ChangeStreamTest, LsnRoundTrip) {
+  uint64_t lsn = (uint64_t{0x16} << 32) | 0xB374D848;
+  EXPECT_EQ(PostgreSQLChangeStream::formatLsn(lsn), "16/B374D848");
+  EXPECT_EQ(PostgreSQLChangeStream::parseLsn("16/B374D848"), lsn);
+  EXPECT_EQ(PostgreSQLChangeStream::parseLsn("garbage"), 0u);
+}
+
+TEST(ChangeStreamTest, ReplicationConninfoAcceptsUris) {
+  std::string conninfo = PostgreSQLChangeStream::replicationConninfo(
+      "postgresql://user@db.example:5433/app?replication=true");
+  EXPECT_NE(conninfo.find("host='db.example'"), std::string::npos);
+  EXPECT_NE(conninfo.find("port='5433'"), std::string::npos);
+  EXPECT_NE(conninfo.find("dbname='app'"), std::string::npos);
+  EXPECT_EQ(conninfo.find("replication=true"), std::string::npos);
+  EXPECT_EQ(conninfo.find("replication='"), std::string::npos);
+  EXPECT_NE(conninfo.find("replication=database"), std::string::npos);
+}
@@ -0,0 +1,117 @@
+#include "PostgreSQLColumnar.h"
+#include "TestSupport.h"
+#include <limits>
+
+namespace {
+
+constexpr Oid Int8Oid = 20;
+constexpr Oid TimestampOid = 1114;
+constexpr Oid TimestampTzOid = 1184;
+
+// Decodes one timestamptz text value; nullopt when it counts as an error.
+std::optional<int64_t> decodeTimestamp(const std::string &text,
+                                       Oid type = TimestampTzOid) {
+  PGresult *result = makeResult({"ts"}, {{text}}, {type});
+  ColumnarResult decoded = PostgreSQLColumnar::decode(result, 1);
+  PQclear(result);
+  const ColumnArray &column = decoded.columns.at(0);
+  if (column.conversionErrors != 0) {
+    EXPECT_FALSE(column.isValid(0));
+    return std::nullopt;
+  }
+  return column.getInt64(0);
+}
+
+std::string bigEndian(int64_t value) {
+  std::string bytes(8, '\0');
+  for (int i = 7; i >= 0; --i) {
+    bytes[i] = static_cast<char>(value & 0xff);
+    value = static_cast<int64_t>(static_cast<uint64_t>(value) >> 8);
+  }
+  return bytes;
+}
+
+} // namespace
+
+TEST(ColumnarTimestampTest, ParsesIsoText) {
+  EXPECT_EQ(decodeTimestamp("1970-01-01 00:00:00+00"), 0);
+  EXPECT_EQ(decodeTimestamp("2000-01-01 00:00:00", TimestampOid),
+            946684800000000LL);
+  EXPECT_EQ(decodeTimestamp("2024-02-29 12:34:56.5+02"),
+            1709202896500000LL);
+  EXPECT_EQ(decodeTimestamp("1970-01-01 00:00:00.000001-00:30"),
+            1800000001LL);
+  EXPECT_EQ(decodeTimestamp("infinity"), std::numeric_limits<int64_t>::max());
+  EXPECT_EQ(decodeTimestamp("-infinity"), std::numeric_limits<int64_t>::min());
+}
+
+TEST(ColumnarTimestampTest, RejectsOutOfRangeFields) {
+  for (const char *text :
+       {"2024-01-01 25:00:00+00", "2024-01-01 23:61:00+00",
+        "2024-01-01 23:59:99+00", "2023-02-29 00:00:00+00",
+        "2024-13-01 00:00:00+00", "2024-04-31 00:00:00+00",
+        "2024-01-01 00:00:00+16", "2024-01-01 00:00:00+01:60",
+        "0000-01-01 00:00:00+00", "2024-01-01 00:00:00 BC"}) {
+    EXPECT_EQ(decodeTimestamp(text), std::nullopt) << text;
+  }
+}
+
+TEST(ColumnarTimestampTest, RejectsValuesThatOverflow) {
+  // int64 microseconds since 1970 end at 294247-01-10 04:00:54.775807.
+  EXPECT_EQ(decodeTimestamp("294247-01-10 04:00:54+00"),
+            9223372036854000000LL);
+  EXPECT_EQ(decodeTimestamp("294247-01-10 04:00:55+00"), std::nullopt);
+  EXPECT_EQ(decodeTimestamp("9999999999999-01-01 00:00:00+00"), std::nullopt);
+}
+
+TEST(ColumnarTimestampTest, DecodesBinaryRelativeToUnixEpoch) {
+  PGresult *result =
+      makeResult({"ts"},
+                 {{bigEndian(0)},
+                  {bigEndian(std::numeric_limits<int64_t>::max())},
+                  {bigEndian(std::numeric_limits<int64_t>::max() - 1)}},
+                 {TimestampTzOid}, 1);
+  ColumnarResult decoded = PostgreSQLColumnar::decode(result, 1);
+  PQclear(result);
+  const ColumnArray &column = decoded.columns.at(0);
+  EXPECT_EQ(column.getInt64(0), 946684800000000LL);
+  EXPECT_EQ(column.getInt64(1), std::numeric_limits<int64_t>::max());
+  EXPECT_FALSE(column.isValid(2));
+  EXPECT_EQ(column.conversionErrors, 1u);
+}
+
+TEST(ColumnarDecodeTest, ParallelDecodeMatchesSequential) {
+  // Enough rows that several threads each get a range.
+  constexpr int rows = 140000;
+  std::vector<std::vector<std::optional<std::string>>> values;
+  values.reserve(rows);
+  for (int i = 0; i < rows; ++i) {
+    if (i % 7 == 0) {
+      values.push_back({std::nullopt, std::nullopt});
+    } else {
+      values.push_back({std::to_string(i), "row" + std::to_string(i)});
+    }
+  }
+  PGresult *result = makeResult({"id", "label"}, values, {Int8Oid, 25});
+  ColumnarResult sequential = PostgreSQLColumnar::decode(result, 1);
+  ColumnarResult parallel = PostgreSQLColumnar::decode(result, 4);
+  PQclear(result);
+
+  ASSERT_FALSE(parallel.hasError());
+  ASSERT_EQ(parallel.rowCount, static_cast<size_t>(rows));
+  for (size_t col = 0; col < 2; ++col) {
+    const ColumnArray &a = sequential.columns[col];
+    const ColumnArray &b = parallel.columns[col];
+    EXPECT_EQ(a.nullCount, b.nullCount);
+    EXPECT_EQ(a.validity, b.validity);
+    EXPECT_EQ(a.int64Values, b.int64Values);
+    EXPECT_EQ(a.offsets, b.offsets);
+    EXPECT_EQ(a.data, b.data);
+  }
+  const ColumnArray &ids = parallel.columns[0];
+  const ColumnArray &labels = parallel.columns[1];
+  EXPECT_EQ(ids.nullCount, static_cast<size_t>((rows + 6) / 7));
+  EXPECT_FALSE(ids.isValid(70000));
+  EXPECT_EQ(ids.getInt64(70001), 70001);
+  EXPECT_EQ(labels.getString(rows - 1), "row" + std::to_string(rows - 1));
+}
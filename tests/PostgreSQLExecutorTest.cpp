@@ -0,0 +1,94 @@
+#include "PostgreSQLExecutor.h"
+#include "TestSupport.h"
+#include <set>
+
+TEST(BoundedMPMCQueueTest, RoundsCapacityUpToPowerOfTwo) {
+  BoundedMPMCQueue<int> queue(3);
+  for (int i = 0; i < 4; ++i) {
+    int value = i;
+    EXPECT_TRUE(queue.tryPush(value)) << i;
+  }
+  int extra = 4;
+  EXPECT_FALSE(queue.tryPush(extra));
+  // A failed push leaves the value with the caller.
+  EXPECT_EQ(extra, 4);
+}
+
+TEST(BoundedMPMCQueueTest, PopsInFifoOrderAndWrapsAround) {
+  BoundedMPMCQueue<int> queue(2);
+  int value;
+  EXPECT_FALSE(queue.tryPop(value));
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 2; ++i) {
+      int pushed = round * 10 + i;
+      ASSERT_TRUE(queue.tryPush(pushed));
+    }
+    for (int i = 0; i < 2; ++i) {
+      ASSERT_TRUE(queue.tryPop(value));
+      EXPECT_EQ(value, round * 10 + i);
+    }
+    EXPECT_FALSE(queue.tryPop(value));
+  }
+}
+
+TEST(BoundedMPMCQueueTest, ConcurrentProducersAndConsumersLoseNothing) {
+  constexpr int producers = 4;
+  constexpr int perProducer = 20000;
+  BoundedMPMCQueue<int> queue(64);
+  std::atomic<int> consumed(0);
+  std::vector<std::vector<int>> seen(producers);
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&queue, p] {
+      for (int i = 0; i < perProducer; ++i) {
+        int value = p * perProducer + i;
+        while (!queue.tryPush(value)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (int c = 0; c < producers; ++c) {
+    threads.emplace_back([&, c] {
+      int value;
+      while (consumed.load() < producers * perProducer) {
+        if (queue.tryPop(value)) {
+          seen[c].push_back(value);
+          consumed.fetch_add(1);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  std::set<int> all;
+  for (const auto &values : seen) {
+    all.insert(values.begin(), values.end());
+  }
+  EXPECT_EQ(all.size(), static_cast<size_t>(producers * perProducer));
+}
+
+using ExecutorServerTest = ServerTest;
+
+TEST_F(ExecutorServerTest, ShutdownFromTaskIsRejected) {
+  PostgreSQLExecutor executor(testConninfo(), 1);
+  auto future = executor.submit(
+      [&executor](PostgreSQLConnection &) { executor.shutdown(); });
+  EXPECT_THROW(future.get(), std::logic_error);
+  EXPECT_EQ(executor.submit([](PostgreSQLConnection &) { return 7; }).get(),
+            7);
+}
+
+TEST_F(ExecutorServerTest, FullQueueSubmitFromTaskThrows) {
+  PostgreSQLExecutor executor(testConninfo(), 1, 2);
+  auto future = executor.submit([&executor](PostgreSQLConnection &) {
+    // The only worker is running this task, so nothing drains the queue.
+    while (true) {
+      executor.submit([](PostgreSQLConnection &) {});
+    }
+  });
+  EXPECT_THROW(future.get(), std::runtime_error);
+}
@@ -0,0 +1,45 @@
+#include "PostgreSQLLargeObject.h"
+#include "TestSupport.h"
+#include <sstream>
+#include <unistd.h>
+
+TEST(LargeObjectTest, EmptyBufferIsAnError) {
+  PostgreSQLConnection connection;
+  PostgreSQLLargeObject object(connection);
+  std::span<std::byte> empty;
+  std::istringstream input("data");
+  std::ostringstream output;
+  EXPECT_EQ(object.writeFrom(input, empty), -1);
+  EXPECT_EQ(object.readTo(output, empty), -1);
+  int pipeFds[2];
+  ASSERT_EQ(pipe(pipeFds), 0);
+  ::close(pipeFds[1]);
+  EXPECT_EQ(object.writeFrom(pipeFds[0], empty), -1);
+  EXPECT_EQ(object.readTo(pipeFds[0], empty), -1);
+  ::close(pipeFds[0]);
+}
+
+using LargeObjectServerTest = ServerTest;
+
+TEST_F(LargeObjectServerTest, StreamsThroughSmallBuffer) {
+  ASSERT_TRUE(connection.beginTransaction());
+  Oid oid = PostgreSQLLargeObject::create(connection);
+  ASSERT_NE(oid, InvalidOid);
+  std::string payload(10000, 'x');
+  std::byte buffer[7];
+  {
+    PostgreSQLLargeObject object(connection);
+    ASSERT_TRUE(object.open(oid, INV_WRITE));
+    std::istringstream input(payload);
+    EXPECT_EQ(object.writeFrom(input, buffer),
+              static_cast<long long>(payload.size()));
+  }
+  PostgreSQLLargeObject object(connection);
+  ASSERT_TRUE(object.open(oid, INV_READ));
+  std::ostringstream output;
+  EXPECT_EQ(object.readTo(output, buffer),
+            static_cast<long long>(payload.size()));
+  EXPECT_EQ(output.str(), payload);
+  object.close();
+  connection.rollbackTransaction();
+}
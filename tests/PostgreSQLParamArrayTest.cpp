@@ -0,0 +1,81 @@
+#include "PostgreSQLParamArray.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+
+template <typename T> bool insideObject(const T &object, const void *pointer) {
+  auto begin = reinterpret_cast<const char *>(&object);
+  auto address = static_cast<const char *>(pointer);
+  return address >= begin && address < begin + sizeof(T);
+}
+
+} // namespace
+
+TEST(ParamArrayTest, EmptyHasNoData) {
+  std::vector<std::string> none;
+  ParamArray params{std::span<const std::string>(none)};
+  EXPECT_EQ(params.size(), 0);
+  EXPECT_EQ(params.data(), nullptr);
+}
+
+TEST(ParamArrayTest, StringsArePassedWithoutCopying) {
+  std::vector<std::string> values = {"a", "bc"};
+  ParamArray params{std::span<const std::string>(values)};
+  ASSERT_EQ(params.size(), 2);
+  EXPECT_EQ(params.data()[0], values[0].c_str());
+  EXPECT_EQ(params.data()[1], values[1].c_str());
+}
+
+TEST(ParamArrayTest, SmallViewsStayInline) {
+  std::string source = "12345";
+  std::vector<std::string_view> views(16, std::string_view(source).substr(0, 3));
+  ParamArray params{std::span<const std::string_view>(views)};
+  ASSERT_EQ(params.size(), 16);
+  EXPECT_TRUE(insideObject(params, params.data()));
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_STREQ(params.data()[i], "123");
+    EXPECT_TRUE(insideObject(params, params.data()[i]));
+  }
+}
+
+TEST(ParamArrayTest, ManyParamsMoveTheArrayToTheHeap) {
+  std::vector<std::string_view> views(17, "x");
+  ParamArray params{std::span<const std::string_view>(views)};
+  ASSERT_EQ(params.size(), 17);
+  EXPECT_FALSE(insideObject(params, params.data()));
+  // The bytes still fit inline.
+  EXPECT_TRUE(insideObject(params, params.data()[16]));
+  EXPECT_STREQ(params.data()[16], "x");
+}
+
+TEST(ParamArrayTest, LongViewsMoveTheBytesToTheHeap) {
+  std::string big(1024, 'y');
+  std::vector<std::string_view> views = {big};
+  ParamArray params{std::span<const std::string_view>(views)};
+  EXPECT_TRUE(insideObject(params, params.data()));
+  EXPECT_FALSE(insideObject(params, params.data()[0]));
+  EXPECT_EQ(std::string(params.data()[0]), big);
+}
+
+TEST(ParamArrayTest, NulloptIsSqlNullAndEmptyViewIsNot) {
+  std::vector<std::optional<std::string_view>> views = {
+      std::nullopt, std::string_view(), std::string_view("v")};
+  ParamArray params{std::span<const std::optional<std::string_view>>(views)};
+  ASSERT_EQ(params.size(), 3);
+  EXPECT_EQ(params.data()[0], nullptr);
+  ASSERT_NE(params.data()[1], nullptr);
+  EXPECT_STREQ(params.data()[1], "");
+  EXPECT_STREQ(params.data()[2], "v");
+}
+
+TEST(NullTerminatedTextTest, InlineAndHeap) {
+  std::string source = "abcdef";
+  NullTerminatedText shortText(std::string_view(source).substr(1, 3));
+  EXPECT_STREQ(shortText.c_str(), "bcd");
+  EXPECT_TRUE(insideObject(shortText, shortText.c_str()));
+  std::string big(1024, 'z');
+  NullTerminatedText longText(big);
+  EXPECT_FALSE(insideObject(longText, longText.c_str()));
+  EXPECT_EQ(std::string(longText.c_str()), big);
+}
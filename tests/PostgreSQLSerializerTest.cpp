@@ -0,0 +1,100 @@
+#include "PostgreSQLSerializer.h"
+#include "TestSupport.h"
+#include <sstream>
+
+namespace {
+
+constexpr Oid BoolOid = 16;
+constexpr Oid Int4Oid = 23;
+constexpr Oid Float8Oid = 701;
+constexpr Oid TextOid = 25;
+
+std::string escaped(void (*append)(OutputBuffer &, const char *, size_t),
+                    const std::string &value) {
+  std::ostringstream stream;
+  {
+    // A tiny buffer so escaping also crosses flushes.
+    OutputBuffer output(stream, 4);
+    append(output, value.data(), value.size());
+  }
+  return stream.str();
+}
+
+std::string serialize(PGresult *result, SerializationFormat format) {
+  std::ostringstream stream;
+  EXPECT_TRUE(PostgreSQLSerializer::write(result, format, stream));
+  return stream.str();
+}
+
+std::string serialize(const QueryResult &result, SerializationFormat format) {
+  std::ostringstream stream;
+  {
+    OutputBuffer output(stream);
+    EXPECT_TRUE(PostgreSQLSerializer::write(result, format, output));
+  }
+  return stream.str();
+}
+
+} // namespace
+
+TEST(SerializerEscapeTest, Csv) {
+  auto csv = &PostgreSQLSerializer::appendCsvEscaped;
+  EXPECT_EQ(escaped(csv, "plain"), "plain");
+  EXPECT_EQ(escaped(csv, ""), "\"\"");
+  EXPECT_EQ(escaped(csv, "a,b"), "\"a,b\"");
+  EXPECT_EQ(escaped(csv, "say \"hi\""), "\"say \"\"hi\"\"\"");
+  EXPECT_EQ(escaped(csv, "two\nlines"), "\"two\nlines\"");
+}
+
+TEST(SerializerEscapeTest, Tsv) {
+  auto tsv = &PostgreSQLSerializer::appendTsvEscaped;
+  EXPECT_EQ(escaped(tsv, "plain"), "plain");
+  EXPECT_EQ(escaped(tsv, "a\tb\\c\nd\re"), "a\\tb\\\\c\\nd\\re");
+}
+
+TEST(SerializerEscapeTest, Json) {
+  auto json = &PostgreSQLSerializer::appendJsonEscaped;
+  EXPECT_EQ(escaped(json, "plain"), "\"plain\"");
+  EXPECT_EQ(escaped(json, "q\"b\\n\n"), "\"q\\\"b\\\\n\\n\"");
+  EXPECT_EQ(escaped(json, std::string("\x01\x1f", 2)), "\"\\u0001\\u001f\"");
+  EXPECT_EQ(escaped(json, "caf\xc3\xa9"), "\"caf\xc3\xa9\"");
+}
+
+TEST(SerializerTest, NullsInEachFormat) {
+  PGresult *result =
+      makeResult({"a", "b"}, {{std::nullopt, std::string("")}});
+  EXPECT_EQ(serialize(result, SerializationFormat::CSV), "a,b\n,\"\"\n");
+  EXPECT_EQ(serialize(result, SerializationFormat::TSV), "a\tb\n\\N\t\n");
+  EXPECT_EQ(serialize(result, SerializationFormat::JSONLines),
+            "{\"a\":null,\"b\":\"\"}\n");
+  PQclear(result);
+}
+
+TEST(SerializerTest, JsonUsesColumnTypes) {
+  PGresult *result = makeResult(
+      {"n", "x", "ok", "s"},
+      {{std::string("42"), std::string("-1.5e+20"), std::string("t"),
+        std::string("7")},
+       {std::string("-3"), std::string("NaN"), std::string("f"),
+        std::nullopt}},
+      {Int4Oid, Float8Oid, BoolOid, TextOid});
+  EXPECT_EQ(serialize(result, SerializationFormat::JSONLines),
+            "{\"n\":42,\"x\":-1.5e+20,\"ok\":true,\"s\":\"7\"}\n"
+            "{\"n\":-3,\"x\":\"NaN\",\"ok\":false,\"s\":null}\n");
+  PQclear(result);
+}
+
+TEST(SerializerTest, QueryResultWritesNullsAndTypes) {
+  PGresult *raw = makeResult({"id", "name"},
+                             {{std::string("1"), std::nullopt},
+                              {std::string("2"), std::string("x,y")}},
+                             {Int4Oid, TextOid});
+  QueryResult result(raw);
+  PQclear(raw);
+  EXPECT_EQ(serialize(result, SerializationFormat::CSV),
+            "id,name\n1,\n2,\"x,y\"\n");
+  EXPECT_EQ(serialize(result, SerializationFormat::TSV),
+            "id\tname\n1\t\\N\n2\tx,y\n");
+  EXPECT_EQ(serialize(result, SerializationFormat::JSONLines),
+            "{\"id\":1,\"name\":null}\n{\"id\":2,\"name\":\"x,y\"}\n");
+}
@@ -0,0 +1,117 @@
+#include "PostgreSQLSingleFlight.h"
+#include <gtest/gtest.h>
+#include <thread>
+
+class SingleFlightTest : public ::testing::Test {
+protected:
+  PostgreSQLSingleFlight flight;
+  PostgreSQLConnection connection;
+
+  PostgreSQLSingleFlight::SharedResult
+  run(const std::string &key, const std::function<QueryResult()> &execute) {
+    return flight.run(key, execute);
+  }
+
+  std::string key(const std::string &query,
+                  const std::vector<std::string> &params,
+                  size_t memoryBudget = 0) {
+    return PostgreSQLSingleFlight::makeKey(connection, query, params,
+                                           memoryBudget);
+  }
+};
+
+TEST_F(SingleFlightTest, KeysDoNotCollide) {
+  EXPECT_EQ(key("SELECT $1", {"a"}), key("SELECT $1", {"a"}));
+  EXPECT_NE(key("SELECT $1, $2", {"a,b"}), key("SELECT $1, $2", {"a", "b"}));
+  EXPECT_NE(key("SELECT $1", {"a"}), key("SELECT $1", {"b"}));
+  EXPECT_NE(key("SELECT 1", {}), key("SELECT 1", {""}));
+  EXPECT_NE(key("SELECT 1", {}, 0), key("SELECT 1", {}, 1024));
+}
+
+TEST_F(SingleFlightTest, ConcurrentCallersShareOneExecution) {
+  constexpr int followers = 4;
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::atomic<int> executions(0);
+  auto execute = [&] {
+    ++executions;
+    released.wait();
+    QueryResult result;
+    result.setAffectedRows(3);
+    return result;
+  };
+
+  PostgreSQLSingleFlight::SharedResult leaderResult;
+  std::thread leader([&] { leaderResult = run("k", execute); });
+  while (flight.getInFlightCount() == 0) {
+    std::this_thread::yield();
+  }
+  std::vector<PostgreSQLSingleFlight::SharedResult> results(followers);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < followers; ++i) {
+    threads.emplace_back([&, i] { results[i] = run("k", execute); });
+  }
+  // Give the followers time to find the in-flight call before it ends.
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  release.set_value();
+  leader.join();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(executions.load(), 1);
+  EXPECT_EQ(flight.getExecutedCount(), 1u);
+  EXPECT_EQ(flight.getSharedCount(), static_cast<size_t>(followers));
+  for (const auto &result : results) {
+    EXPECT_EQ(result, leaderResult);
+  }
+  EXPECT_EQ(leaderResult->getAffectedRows(), 3);
+  EXPECT_EQ(flight.getInFlightCount(), 0u);
+}
+
+TEST_F(SingleFlightTest, FinishedCallsAreNotCached) {
+  int executions = 0;
+  auto execute = [&] {
+    ++executions;
+    return QueryResult();
+  };
+  auto first = run("k", execute);
+  auto second = run("k", execute);
+  EXPECT_EQ(executions, 2);
+  EXPECT_NE(first, second);
+  EXPECT_EQ(flight.getSharedCount(), 0u);
+}
+
+TEST_F(SingleFlightTest, ExceptionReachesCallerAndClearsKey) {
+  EXPECT_THROW(run("k", []() -> QueryResult {
+                 throw std::runtime_error("boom");
+               }),
+               std::runtime_error);
+  EXPECT_EQ(flight.getInFlightCount(), 0u);
+  auto result = run("k", [] { return QueryResult(); });
+  EXPECT_FALSE(result->hasError());
+}
+
+TEST_F(SingleFlightTest, ErrorsAreSharedLikeResults) {
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  auto execute = [&] {
+    released.wait();
+    QueryResult result;
+    result.setErrorMessage("relation does not exist");
+    return result;
+  };
+  PostgreSQLSingleFlight::SharedResult first;
+  PostgreSQLSingleFlight::SharedResult second;
+  std::thread leader([&] { first = run("k", execute); });
+  while (flight.getInFlightCount() == 0) {
+    std::this_thread::yield();
+  }
+  std::thread follower([&] { second = run("k", execute); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  release.set_value();
+  leader.join();
+  follower.join();
+  EXPECT_EQ(first, second);
+  EXPECT_TRUE(second->hasError());
+}
@@ -0,0 +1,55 @@
+#include "PostgreSQLSlowQueryLog.h"
+#include <gtest/gtest.h>
+
+namespace {
+
+SlowQueryLogConfig smallLog() {
+  SlowQueryLogConfig config;
+  config.threshold = std::chrono::milliseconds(10);
+  config.capacity = 2;
+  return config;
+}
+
+} // namespace
+
+TEST(SlowQueryLogTest, IgnoresFastStatements) {
+  PostgreSQLSlowQueryLog log(smallLog());
+  log.record("SELECT 1", {}, std::chrono::milliseconds(1), 1);
+  EXPECT_TRUE(log.getEntries().empty());
+  EXPECT_EQ(log.getTotalRecorded(), 0u);
+}
+
+TEST(SlowQueryLogTest, KeepsMostRecentInOrder) {
+  PostgreSQLSlowQueryLog log(smallLog());
+  for (const char *query : {"SELECT 1", "SELECT 2", "SELECT 3"}) {
+    log.record(query, {}, std::chrono::milliseconds(20), 1);
+  }
+  auto entries = log.getEntries();
+  ASSERT_EQ(entries.size(), 2u);
+  EXPECT_EQ(entries[0].query, "SELECT 2");
+  EXPECT_EQ(entries[1].query, "SELECT 3");
+  EXPECT_EQ(log.getTotalRecorded(), 3u);
+}
+
+TEST(SlowQueryLogTest, RedactsParamsButKeepsNulls) {
+  PostgreSQLSlowQueryLog log(smallLog());
+  log.record("SELECT $1, $2", {std::string("secret"), std::nullopt},
+             std::chrono::milliseconds(20), 1);
+  auto entries = log.getEntries();
+  ASSERT_EQ(entries.size(), 1u);
+  ASSERT_EQ(entries[0].params.size(), 2u);
+  EXPECT_EQ(entries[0].params[0], "<redacted 6 bytes>");
+  EXPECT_FALSE(entries[0].params[1].has_value());
+}
+
+TEST(SlowQueryLogTest, SampledExplainDoesNotBlockRecording) {
+  SlowQueryLogConfig config = smallLog();
+  config.explainSampleRate = 1;
+  // No side connection: the worker produces no plan, but recording and
+  // destruction must still go through.
+  PostgreSQLSlowQueryLog log(config);
+  log.record("SELECT 1", {}, std::chrono::milliseconds(20), 1);
+  auto entries = log.getEntries();
+  ASSERT_EQ(entries.size(), 1u);
+  EXPECT_EQ(entries[0].query, "SELECT 1");
+}
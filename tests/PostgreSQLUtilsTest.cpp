@@ -0,0 +1,107 @@
+#include "PostgreSQLUtils.h"
+#include "TestSupport.h"
+#include <stdexcept>
+
+namespace {
+
+PGresult *numberedRows(int count) {
+  std::vector<std::vector<std::optional<std::string>>> rows;
+  for (int i = 0; i < count; ++i) {
+    rows.push_back({std::to_string(i), "row " + std::to_string(i)});
+  }
+  return makeResult({"id", "label"}, rows);
+}
+
+class SpillTest : public ::testing::Test {
+protected:
+  void TearDown() override { QueryResult::setSpillEnabled(false); }
+};
+
+} // namespace
+
+TEST_F(SpillTest, OverBudgetFailsWhenSpillingIsDisabled) {
+  PGResultWrapper raw(numberedRows(100));
+  QueryResult result;
+  result.setMemoryBudget(1024);
+  EXPECT_FALSE(result.loadFromResult(raw.get()));
+  EXPECT_EQ(result.getErrorMessage(), "Memory budget exceeded");
+  EXPECT_FALSE(result.isSpilled());
+}
+
+TEST_F(SpillTest, SpilledRowsReadBackInOrder) {
+  QueryResult::setSpillEnabled(true);
+  PGResultWrapper raw(numberedRows(100));
+  QueryResult result;
+  result.setMemoryBudget(1024);
+  ASSERT_TRUE(result.loadFromResult(raw.get()));
+  ASSERT_TRUE(result.isSpilled());
+  EXPECT_EQ(result.getRowCount(), 100u);
+  EXPECT_LE(result.getMemoryUsage(), 1024u);
+  EXPECT_EQ(result.getRow(99).getString("label"), "row 99");
+  EXPECT_EQ(result.getFirstRow().getInt("id"), 0);
+
+  int expected = 0;
+  EXPECT_TRUE(result.forEachRow([&](const ResultRow &row) {
+    EXPECT_EQ(row.getInt("id", -1), expected++);
+    return true;
+  }));
+  EXPECT_EQ(expected, 100);
+}
+
+TEST_F(SpillTest, GetAllRowsRefusesSpilledResult) {
+  QueryResult::setSpillEnabled(true);
+  PGResultWrapper raw(numberedRows(100));
+  QueryResult result;
+  result.setMemoryBudget(1024);
+  ASSERT_TRUE(result.loadFromResult(raw.get()));
+  EXPECT_THROW(result.getAllRows(), std::logic_error);
+}
+
+TEST_F(SpillTest, MutableSpilledRowKeepsWrites) {
+  QueryResult::setSpillEnabled(true);
+  PGResultWrapper raw(numberedRows(100));
+  QueryResult result;
+  result.setMemoryBudget(1024);
+  ASSERT_TRUE(result.loadFromResult(raw.get()));
+  ResultRow &row = result.getRow(90);
+  row = ResultRow({"id", "label"}, {"90", "changed"});
+  // Reading other spilled rows must not overwrite the handed-out row.
+  EXPECT_EQ(result.getRow(91).getString("label"), "row 91");
+  EXPECT_EQ(row.getString("label"), "changed");
+  EXPECT_EQ(std::as_const(result).getRow(90).getString("label"), "changed");
+}
+
+TEST(QueryResultTest, InMemoryResultKeepsAllRows) {
+  PGResultWrapper raw(numberedRows(3));
+  QueryResult result(raw.get());
+  ASSERT_FALSE(result.hasError());
+  ASSERT_EQ(result.getAllRows().size(), 3u);
+  EXPECT_EQ(result.getAllRows()[2].getString("label"), "row 2");
+  EXPECT_EQ(result.getColumnNames(), (std::vector<std::string>{"id", "label"}));
+}
+
+using PostgreSQLUtilsServerTest = ServerTest;
+
+TEST_F(PostgreSQLUtilsServerTest, CopyWithBudgetReturnsErrorAndKeepsConnection) {
+  ASSERT_FALSE(PostgreSQLUtils::executeQuery(
+                   connection, "CREATE TEMP TABLE copy_target (id int)")
+                   .hasError());
+  QueryResult copy = PostgreSQLUtils::executeQuery(
+      connection, "COPY copy_target FROM STDIN", 1024);
+  EXPECT_TRUE(copy.hasError());
+  copy = PostgreSQLUtils::executeQuery(connection, "COPY copy_target TO STDOUT",
+                                       1024);
+  EXPECT_TRUE(copy.hasError());
+  QueryResult after = PostgreSQLUtils::executeQuery(connection, "SELECT 1 AS one");
+  ASSERT_FALSE(after.hasError());
+  EXPECT_EQ(after.getFirstInt("one"), 1);
+}
+
+TEST_F(PostgreSQLUtilsServerTest, BudgetedMultiStatementKeepsLastResult) {
+  QueryResult result = PostgreSQLUtils::executeQuery(
+      connection, "SELECT 1 AS a, 2 AS b; SELECT 3 AS c", 1 << 20);
+  ASSERT_FALSE(result.hasError());
+  EXPECT_EQ(result.getColumnNames(), std::vector<std::string>{"c"});
+  EXPECT_EQ(result.getRowCount(), 1u);
+  EXPECT_EQ(result.getFirstInt("c"), 3);
+}
@@ -0,0 +1,32 @@
+#include "PostgreSQLWriteCoalescer.h"
+#include "TestSupport.h"
+
+using WriteCoalescerServerTest = ServerTest;
+
+TEST_F(WriteCoalescerServerTest, FailedUnitDoesNotAbortBatch) {
+  ASSERT_FALSE(PostgreSQLUtils::executeQuery(
+                   connection, "CREATE TEMP TABLE coalesced (id int UNIQUE)")
+                   .hasError());
+  std::vector<std::future<QueryResult>> futures;
+  {
+    // A long window so all units land in one batch.
+    PostgreSQLWriteCoalescer coalescer(connection, 16,
+                                       std::chrono::milliseconds(200));
+    for (const char *id : {"1", "2", "1", "3"}) {
+      futures.push_back(
+          coalescer.submit("INSERT INTO coalesced VALUES ($1)", {id}));
+    }
+    coalescer.shutdown();
+    EXPECT_EQ(coalescer.getCommittedBatches(), 1u);
+  }
+  EXPECT_FALSE(futures[0].get().hasError());
+  EXPECT_FALSE(futures[1].get().hasError());
+  QueryResult duplicate = futures[2].get();
+  EXPECT_TRUE(duplicate.hasError());
+  EXPECT_NE(duplicate.getErrorMessage().find("duplicate"), std::string::npos);
+  EXPECT_FALSE(futures[3].get().hasError());
+  EXPECT_EQ(PostgreSQLUtils::executeQuery(
+                connection, "SELECT count(*) AS n FROM coalesced")
+                .getFirstInt("n"),
+            3);
+}
@@ -0,0 +1,62 @@
+#ifndef POSTGRESQL_TEST_SUPPORT_H
+#define POSTGRESQL_TEST_SUPPORT_H
+
+#include "PostgreSQLConnection.h"
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <cstring>
+#include <libpq-fe.h>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Builds a client-side PGresult, so result handling can be tested without
+// a server. Columns default to type text; format 1 marks every column as
+// binary. A std::nullopt cell is SQL NULL.
+inline PGresult *
+makeResult(const std::vector<std::string> &columns,
+           const std::vector<std::vector<std::optional<std::string>>> &rows,
+           const std::vector<Oid> &types = {}, int format = 0) {
+  PGresult *result = PQmakeEmptyPGresult(nullptr, PGRES_TUPLES_OK);
+  std::vector<PGresAttDesc> attributes(columns.size());
+  for (size_t i = 0; i < columns.size(); ++i) {
+    std::memset(&attributes[i], 0, sizeof(PGresAttDesc));
+    attributes[i].name = const_cast<char *>(columns[i].c_str());
+    attributes[i].typid = types.empty() ? 25 : types[i]; // text
+    attributes[i].typlen = -1;
+    attributes[i].atttypmod = -1;
+    attributes[i].format = format;
+  }
+  PQsetResultAttrs(result, static_cast<int>(attributes.size()),
+                   attributes.data());
+  for (size_t row = 0; row < rows.size(); ++row) {
+    for (size_t col = 0; col < columns.size(); ++col) {
+      const auto &value = rows[row][col];
+      PQsetvalue(result, static_cast<int>(row), static_cast<int>(col),
+                 value ? const_cast<char *>(value->data()) : nullptr,
+                 value ? static_cast<int>(value->size()) : -1);
+    }
+  }
+  return result;
+}
+
+// Empty when no test server is configured.
+inline std::string testConninfo() {
+  const char *conninfo = std::getenv("PQXX_EXECUTOR_TEST_CONNINFO");
+  return conninfo ? conninfo : "";
+}
+
+// Fixture for tests that talk to a real server.
+class ServerTest : public ::testing::Test {
+protected:
+  PostgreSQLConnection connection;
+
+  void SetUp() override {
+    if (testConninfo().empty()) {
+      GTEST_SKIP() << "PQXX_EXECUTOR_TEST_CONNINFO is not set";
+    }
+    ASSERT_TRUE(connection.connect(testConninfo()));
+  }
+};
+
+#endif // POSTGRESQL_TEST_SUPPORT_H